@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 
 #include <dds/sub/ddssub.hpp>
@@ -9,6 +10,7 @@
 #include "ShapeType.hpp"
 #include "rx4dds/rx4dds.h"
 #include "solar_system.h"
+#include "rx4dds_bench.h"
 
 namespace rx = rxcpp;
 namespace rxu = rxcpp::util;
@@ -48,15 +50,12 @@ void test_dynamic_correlator(int domain_id, int sample_count)
   auto subscription =
     topic_sub
       .create_observable()
-      .op(rx4dds::group_by_dds_instance([](const ShapeType & shape) {
+      .op(rx4dds::group_by_dds_instance([](const ShapeType & shape) -> const dds::core::string & {
             return shape.color(); 
         }))
       .map([](rxcpp::grouped_observable<dds::core::string, rti::sub::LoanedSample<ShapeType>> go) {
          return go.op(rx4dds::to_unkeyed())
-                  .op(rx4dds::complete_on_dispose())
-                  .op(rx4dds::error_on_no_alive_writers())
-                  .op(rx4dds::skip_invalid_samples())
-                  .op(rx4dds::map_samples_to_data())
+                  .op(rx4dds::instance_lifecycle())
                   .publish()
                   .ref_count()
                   .as_dynamic();
@@ -127,16 +126,13 @@ void test_keyed_topic(int domain_id, int sample_count)
   auto observable = 
     topic_sub.create_observable()
              >> group_by_dds_instance(
-                [](const ShapeType & shape) { return shape.color(); });
+                [](const ShapeType & shape) -> const dds::core::string & { return shape.color(); });
 
   auto subscription1 =
     observable
       .flat_map([&count](GroupedObservable go) {
             return go >> to_unkeyed()
-                      >> complete_on_dispose()
-                      >> error_on_no_alive_writers()
-                      >> skip_invalid_samples()
-                      >> map_samples_to_data();
+                      >> instance_lifecycle();
          }, 
          [](GroupedObservable, ShapeType & shape) { 
                 return rx4dds::detail::remove_const(shape);  
@@ -181,10 +177,7 @@ void test_keyless_topic(int domain_id, int sample_count)
   rx4dds::TopicSubscription<ShapeType> topic_sub(participant, "Square", waitset, worker);
 
   auto observable = topic_sub.create_observable()
-                      >> complete_on_dispose()
-                      >> error_on_no_alive_writers()
-                      >> skip_invalid_samples()
-                      >> map_samples_to_data();
+                      >> instance_lifecycle();
 
   auto subscription1 =
     observable >> subscribe<ShapeType>([&count](const ShapeType & shape) {
@@ -217,6 +210,58 @@ void test_keyless_topic(int domain_id, int sample_count)
   //subscription1.unsubscribe();
 }
 
+// conflate_per_instance(): an instance updated and then disposed 
+// within one period still gets its last update out. The period is
+// an hour, so only the dispose can let it out.
+void test_conflation(int, int)
+{
+  using namespace rx4dds;
+
+  std::vector<ShapeType> data(3);
+  std::vector<dds::sub::SampleInfo> infos(3);
+  std::vector<rti::sub::LoanedSample<ShapeType>> samples;
+
+  for (size_t i = 0; i < data.size(); ++i)
+  {
+    data[i] = ShapeType("BLUE", (int) i, (int) i, 30);
+
+    DDS_SampleInfo & native = infos[i]->native();
+    native.valid_data = DDS_BOOLEAN_TRUE;
+    native.sample_state = DDS_NOT_READ_SAMPLE_STATE;
+    native.view_state = DDS_NOT_NEW_VIEW_STATE;
+    native.instance_state = DDS_ALIVE_INSTANCE_STATE;
+
+    samples.push_back(rti::sub::LoanedSample<ShapeType>(&data[i], &infos[i]));
+  }
+
+  DDS_SampleInfo & disposed = infos.back()->native();
+  disposed.valid_data = DDS_BOOLEAN_FALSE;
+  disposed.instance_state = DDS_NOT_ALIVE_DISPOSED_INSTANCE_STATE;
+
+  rxcpp::subjects::subject<rti::sub::LoanedSample<ShapeType>> subject;
+  std::vector<int> received;
+
+  rxcpp::composite_subscription subscription =
+    (subject.get_observable() >> conflate_per_instance(std::chrono::hours(1)))
+      .subscribe([&received](const ShapeType & shape) {
+        received.push_back(shape.x());
+      }, print_exception_on_error());
+
+  auto subscriber = subject.get_subscriber();
+  for (const rti::sub::LoanedSample<ShapeType> & sample : samples)
+    subscriber.on_next(sample);
+
+  size_t on_dispose = received.size();
+  subscriber.on_completed();
+  subscription.unsubscribe();
+
+  std::cout << "test_conflation: " << on_dispose << " update(s) out on dispose, "
+            << received.size() << " in total\n";
+
+  if ((on_dispose != 1) || (received.size() != 1) || (received[0] != 1))
+    throw std::runtime_error("test_conflation: the update before the dispose was lost");
+}
+
 void test_original_subscriber(int domain_id, int sample_count)
 {
     // Create a DomainParticipant with default Qos
@@ -343,12 +388,32 @@ int main(int argc, char *argv [])
         test_keyed_topic(domain_id, sample_count);
       else if (name == "keyless_topic")
         test_keyless_topic(domain_id, sample_count);
+      else if (name == "conflation")
+        test_conflation(domain_id, sample_count);
       else if (name == "rx_demo1")
         rx_demo1();
       else if (name == "rx_demo2")
         rx_demo2();
       else if (name == "rx_demo3")
         rx_demo3();
+      else if (name == "bench_window_aggregate")
+        bench_window_aggregate();
+      else if (name == "bench_window_join")
+        bench_window_join();
+      else if (name == "bench_filter_expression")
+        bench_filter_expression();
+      else if (name == "bench_instance_lifecycle")
+        bench_instance_lifecycle();
+      else if (name == "bench_no_writers_burst")
+        bench_no_writers_burst();
+      else if (name == "bench_do_effect")
+        bench_do_effect();
+      else if (name == "bench_pacing")
+        bench_pacing();
+      else if (name == "bench_write_with_handle")
+        bench_write_with_handle(domain_id);
+      else if (name == "bench_in_place_write")
+        bench_in_place_write(domain_id);
       else
         test_original_subscriber(domain_id, sample_count);
     } 
@@ -0,0 +1,113 @@
+// Not a benchmark: fails if the keyless topic pipeline touches the heap
+// per sample once it is running. It is a program of its own because it
+// hooks every allocation of the process.
+//
+// The count comes from the debug CRT's allocation hook rather than from
+// a replacement operator new: Connext allocates the memory behind a
+// dds::core::string, and most of its own, with malloc, which a
+// replacement operator new never sees. The hook sees malloc, new and
+// realloc alike, from rx4dds, rxcpp and the Connext libraries, as long
+// as they share the debug CRT, so it only works in the Debug and Debug DLL
+// configurations. Allocations of the CRT itself (_CRT_BLOCK) are not counted.
+
+#include <cstdio>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+#include <dds/sub/ddssub.hpp>
+#include <dds/core/ddscore.hpp>
+
+#include "ShapeType.hpp"
+#include "rx4dds/rx4dds.h"
+
+namespace {
+
+  std::atomic<unsigned long long> heap_allocations(0);
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+  int count_allocation(int type, void *, size_t, int block_type, long, const unsigned char *, int)
+  {
+    if ((block_type != _CRT_BLOCK) && ((type == _HOOK_ALLOC) || (type == _HOOK_REALLOC)))
+      heap_allocations++;
+
+    return TRUE;
+  }
+#endif
+
+} // anonymous namespace
+
+// The test_keyless_topic pipeline, fed from a subject.
+void check_allocations()
+{
+  const size_t sample_count = 100000;
+
+  std::vector<ShapeType> data(sample_count);
+  std::vector<dds::sub::SampleInfo> infos(sample_count);
+  std::vector<rti::sub::LoanedSample<ShapeType>> samples;
+
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    data[i] = ShapeType("BLUE", (int) i, (int) i, 30);
+
+    DDS_SampleInfo & native = infos[i]->native();
+    native.valid_data = DDS_BOOLEAN_TRUE;
+    native.sample_state = DDS_NOT_READ_SAMPLE_STATE;
+    native.view_state = DDS_NOT_NEW_VIEW_STATE;
+    native.instance_state = DDS_ALIVE_INSTANCE_STATE;
+
+    samples.push_back(rti::sub::LoanedSample<ShapeType>(&data[i], &infos[i]));
+  }
+
+  rxcpp::subjects::subject<rti::sub::LoanedSample<ShapeType>> subject;
+  long long count = 0;
+
+  rxcpp::composite_subscription subscription =
+    (subject.get_observable() >> rx4dds::instance_lifecycle())
+      .subscribe([&count](const ShapeType & shape) {
+        count += shape.x();
+      });
+
+  auto subscriber = subject.get_subscriber();
+
+  // Warm up, so that one-time allocations of rxcpp aren't counted.
+  subscriber.on_next(samples[0]);
+
+  unsigned long long before = heap_allocations;
+  for (const rti::sub::LoanedSample<ShapeType> & sample : samples)
+    subscriber.on_next(sample);
+  unsigned long long allocations = heap_allocations - before;
+
+  subscription.unsubscribe();
+
+  printf("check_allocations: %llu heap allocations for %lu samples\n",
+         allocations, (unsigned long) sample_count);
+
+  if (allocations != 0)
+    throw std::runtime_error("check_allocations: the keyless topic pipeline allocates per sample");
+}
+
+int main()
+{
+#if defined(_MSC_VER) && defined(_DEBUG)
+  _CrtSetAllocHook(count_allocation);
+
+  try {
+    check_allocations();
+  }
+  catch (const std::exception& ex) {
+    fprintf(stderr, "Exception in check_allocations(): %s\n", ex.what());
+    return -1;
+  }
+
+  return 0;
+#else
+  fprintf(stderr, "check_allocations: needs the debug CRT's allocation hook; "
+                  "build the Debug configuration.\n");
+  return -1;
+#endif
+}
@@ -0,0 +1,617 @@
+#include "rx4dds_bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <limits>
+
+#include <dds/dds.hpp>
+
+#include "ShapeType.hpp"
+#include "rx4dds/rx4dds.h"
+#include "rx4dds/filter_expression.h"
+
+namespace {
+
+  typedef std::chrono::steady_clock bench_clock;
+
+  double nanos_per_sample(bench_clock::time_point start, 
+                          bench_clock::time_point end, 
+                          long long samples)
+  {
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / samples;
+  }
+
+  struct Min
+  {
+    int operator ()(int a, int b) const { return std::min(a, b); }
+  };
+
+  // The filters.js style: rescan the whole window for every sample.
+  double naive_window_min(size_t window_size, long long samples)
+  {
+    std::deque<int> window;
+    volatile int sink = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (long long i = 0; i < samples; ++i)
+    {
+      window.push_back((int) ((i * 7919) % 100003));
+      if (window.size() > window_size)
+        window.pop_front();
+
+      sink = *std::min_element(window.begin(), window.end());
+    }
+    return nanos_per_sample(start, bench_clock::now(), samples);
+  }
+
+  template <class WindowOp>
+  double rx_window_min(WindowOp window_op, long long samples)
+  {
+    rxcpp::subjects::subject<int> subject;
+    volatile int sink = 0;
+
+    rxcpp::composite_subscription subscription =
+      subject.get_observable()
+        .op(window_op)
+        .subscribe([&sink](int min) { sink = min; });
+
+    auto subscriber = subject.get_subscriber();
+
+    bench_clock::time_point start = bench_clock::now();
+    for (long long i = 0; i < samples; ++i)
+      subscriber.on_next((int) ((i * 7919) % 100003));
+
+    double result = nanos_per_sample(start, bench_clock::now(), samples);
+    subscription.unsubscribe();
+    return result;
+  }
+
+} // anonymous namespace
+
+void bench_window_aggregate()
+{
+  const long long samples = 2000000;
+
+  printf("%10s %16s %16s %16s\n", "window", "count ns/sample", "time ns/sample", "naive ns/sample");
+
+  for (size_t window_size = 100; window_size <= 1000000; window_size *= 10)
+  {
+    double count_based = 
+      rx_window_min(rx4dds::window_aggregate(window_size, Min()), samples);
+
+    // One sample per tick, so a time window of window_size ticks 
+    // holds the same number of elements as the count-based window.
+    long long tick = 0;
+    double time_based = 
+      rx_window_min(rx4dds::window_aggregate((long long) window_size, 
+                                             [tick](int) mutable { return tick++; },
+                                             Min()),
+                    samples);
+
+    // The rescan is too slow to be worth waiting for beyond 1e4.
+    if (window_size <= 10000)
+      printf("%10lu %16.1f %16.1f %16.1f\n", 
+             (unsigned long) window_size, count_based, time_based, naive_window_min(window_size, samples));
+    else
+      printf("%10lu %16.1f %16.1f %16s\n", 
+             (unsigned long) window_size, count_based, time_based, "-");
+  }
+}
+
+namespace {
+
+  struct SyntheticSensor
+  {
+    int sensor_id;
+    long long ts;
+    int pos_x;
+  };
+
+} // anonymous namespace
+
+// Two synthetic topics at 100k samples/s each (one sample every 10 
+// usec of event time) joined on sensor id within +/- 1 msec.
+void bench_window_join()
+{
+  const long long samples_per_side = 1000000;
+  const long long period_usec = 10;
+  const long long window_usec = 1000;
+  const int sensors = 16;
+
+  rxcpp::subjects::subject<SyntheticSensor> left_subject, right_subject;
+  auto timestamp = [](const SyntheticSensor & s) { return s.ts; };
+  auto key = [](const SyntheticSensor & s) { return s.sensor_id; };
+  long long matches = 0;
+
+  rxcpp::composite_subscription subscription =
+    rx4dds::window_join(left_subject.get_observable() >> rx4dds::assign_watermarks(timestamp, 0),
+                        right_subject.get_observable() >> rx4dds::assign_watermarks(timestamp, 0),
+                        key, 
+                        key, 
+                        window_usec)
+      .subscribe([&matches](const rx4dds::Timestamped<std::pair<SyntheticSensor, SyntheticSensor>> & joined) {
+          if (!joined.is_watermark)
+            matches++;
+      });
+
+  auto left = left_subject.get_subscriber();
+  auto right = right_subject.get_subscriber();
+
+  bench_clock::time_point start = bench_clock::now();
+  for (long long i = 0; i < samples_per_side; ++i)
+  {
+    SyntheticSensor sample = { (int) (i % sensors), i * period_usec, (int) i };
+    left.on_next(sample);
+    sample.ts += period_usec / 2;
+    right.on_next(sample);
+  }
+  bench_clock::time_point end = bench_clock::now();
+
+  double seconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1e6;
+  printf("window_join: %lld samples per side, %lld matches, %.1f ns/sample, %.0f samples/s per side\n",
+         samples_per_side,
+         matches,
+         nanos_per_sample(start, end, 2 * samples_per_side),
+         samples_per_side / seconds);
+
+  subscription.unsubscribe();
+}
+
+namespace {
+
+  struct BenchSensorData
+  {
+    int sensor_id;
+    long long ts;
+    int pos_x;
+    int pos_y;
+    double vel;
+  };
+
+  template <class Predicate>
+  double filter_pass(const std::vector<BenchSensorData> & samples, 
+                     int rounds, 
+                     Predicate predicate, 
+                     long long & matches)
+  {
+    // The fastest round: the ratio of two averages moved by 30% from
+    // run to run on a shared VM.
+    double best = std::numeric_limits<double>::max();
+    matches = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+      bench_clock::time_point start = bench_clock::now();
+      for (const BenchSensorData & s : samples)
+        matches += predicate(s) ? 1 : 0;
+
+      best = (std::min)(best, nanos_per_sample(start, bench_clock::now(), (long long) samples.size()));
+    }
+
+    return best;
+  }
+
+} // anonymous namespace
+
+// The same rule as a compiled filter program and as a hand-written 
+// lambda, over a buffer of DEBS-like sensor samples.
+void bench_filter_expression()
+{
+  const size_t sample_count = 100000;
+  const int rounds = 100;
+
+  std::vector<BenchSensorData> samples(sample_count);
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    BenchSensorData & s = samples[i];
+    s.sensor_id = (int) (i % 16);
+    s.ts = (long long) i * 10;
+    s.pos_x = (int) ((i * 7919) % 50000) - 25000;
+    s.pos_y = (int) ((i * 104729) % 70000) - 35000;
+    s.vel = (double) (i % 1000) / 100;
+  }
+
+  rx4dds::FilterSchema<BenchSensorData> schema;
+  schema.field("sensor_id", &BenchSensorData::sensor_id)
+        .field("ts", &BenchSensorData::ts)
+        .field("pos_x", &BenchSensorData::pos_x)
+        .field("pos_y", &BenchSensorData::pos_y)
+        .field("vel", &BenchSensorData::vel);
+
+  std::vector<std::string> rule;
+  rule.push_back("greater_than_equal pos_x 0");
+  rule.push_back("less_than pos_y 10000");
+  rule.push_back("not_equal sensor_id 4");
+  rule.push_back("greater_than vel 2.5");
+
+  rx4dds::FilterProgram<BenchSensorData> program = rx4dds::compile_filter(rule, schema);
+
+  long long compiled_matches = 0, lambda_matches = 0;
+  double compiled = filter_pass(samples, rounds, program, compiled_matches);
+  double lambda = 
+    filter_pass(samples, rounds, 
+                [](const BenchSensorData & s) {
+                  return (s.pos_x >= 0) && (s.pos_y < 10000) && (s.sensor_id != 4) && (s.vel > 2.5);
+                },
+                lambda_matches);
+
+  printf("filter_expression: %lu checks, %.2f ns/sample compiled, %.2f ns/sample lambda, ratio %.2f\n",
+         (unsigned long) program.size(), compiled, lambda, compiled / lambda);
+
+  // The compiled program is meant to stay within 2x of the lambda.
+  printf("filter_expression: compiled program %s the 2x target\n", 
+         (compiled / lambda <= 2.0) ? "meets" : "MISSES");
+
+  if (compiled_matches != lambda_matches)
+    printf("filter_expression: MISMATCH %lld compiled vs %lld lambda matches\n", 
+           compiled_matches, lambda_matches);
+}
+
+namespace {
+
+  template <class Pipeline>
+  double lifecycle_pass(const std::vector<rti::sub::LoanedSample<ShapeType>> & samples, 
+                        int rounds,
+                        Pipeline pipeline)
+  {
+    rxcpp::subjects::subject<rti::sub::LoanedSample<ShapeType>> subject;
+    volatile int sink = 0;
+
+    rxcpp::composite_subscription subscription =
+      pipeline(subject.get_observable())
+        .subscribe([&sink](const ShapeType & shape) { sink = shape.x(); });
+
+    auto subscriber = subject.get_subscriber();
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int r = 0; r < rounds; ++r)
+      for (const rti::sub::LoanedSample<ShapeType> & sample : samples)
+        subscriber.on_next(sample);
+
+    double result = nanos_per_sample(start, bench_clock::now(), (long long) rounds * samples.size());
+    subscription.unsubscribe();
+    return result;
+  }
+
+} // anonymous namespace
+
+// The four-stage lifecycle chain against the fused instance_lifecycle()
+// over alive, valid samples, i.e., the per-sample cost of the common case.
+void bench_instance_lifecycle()
+{
+  const size_t sample_count = 10000;
+  const int rounds = 100;
+
+  std::vector<ShapeType> data(sample_count);
+  std::vector<dds::sub::SampleInfo> infos(sample_count);
+  std::vector<rti::sub::LoanedSample<ShapeType>> samples;
+
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    data[i] = ShapeType("BLUE", (int) i, (int) i, 30);
+
+    DDS_SampleInfo & native = infos[i]->native();
+    native.valid_data = DDS_BOOLEAN_TRUE;
+    native.sample_state = DDS_NOT_READ_SAMPLE_STATE;
+    native.view_state = DDS_NOT_NEW_VIEW_STATE;
+    native.instance_state = DDS_ALIVE_INSTANCE_STATE;
+
+    samples.push_back(rti::sub::LoanedSample<ShapeType>(&data[i], &infos[i]));
+  }
+
+  double chained = 
+    lifecycle_pass(samples, rounds, [](rxcpp::observable<rti::sub::LoanedSample<ShapeType>> source) {
+      return source >> rx4dds::complete_on_dispose()
+                    >> rx4dds::error_on_no_alive_writers()
+                    >> rx4dds::skip_invalid_samples()
+                    >> rx4dds::map_samples_to_data();
+    });
+
+  double fused = 
+    lifecycle_pass(samples, rounds, [](rxcpp::observable<rti::sub::LoanedSample<ShapeType>> source) {
+      return source >> rx4dds::instance_lifecycle();
+    });
+
+  printf("instance_lifecycle: %.1f ns/sample chained, %.1f ns/sample fused\n", chained, fused);
+}
+
+namespace {
+
+  // Time to deliver one NOT_ALIVE_NO_WRITERS sample to each of many 
+  // per-instance streams, as when a publisher with that many instances dies.
+  template <class Pipeline, class OnNext, class OnError>
+  double no_writers_burst(size_t instances, Pipeline pipeline, OnNext on_next, OnError on_error)
+  {
+    ShapeType data("BLUE", 0, 0, 30);
+    dds::sub::SampleInfo info;
+    DDS_SampleInfo & native = info->native();
+    native.valid_data = DDS_BOOLEAN_FALSE;
+    native.sample_state = DDS_NOT_READ_SAMPLE_STATE;
+    native.view_state = DDS_NOT_NEW_VIEW_STATE;
+    native.instance_state = DDS_NOT_ALIVE_NO_WRITERS_INSTANCE_STATE;
+    rti::sub::LoanedSample<ShapeType> sample(&data, &info);
+
+    std::vector<rxcpp::subjects::subject<rti::sub::LoanedSample<ShapeType>>> subjects(instances);
+    std::vector<rxcpp::composite_subscription> subscriptions;
+    for (auto & subject : subjects)
+      subscriptions.push_back(pipeline(subject.get_observable()).subscribe(on_next, on_error));
+
+    bench_clock::time_point start = bench_clock::now();
+    for (auto & subject : subjects)
+      subject.get_subscriber().on_next(sample);
+    bench_clock::time_point end = bench_clock::now();
+
+    for (auto & subscription : subscriptions)
+      subscription.unsubscribe();
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+  }
+
+} // anonymous namespace
+
+void bench_no_writers_burst()
+{
+  const size_t instances = 50000;
+  long long errors = 0, ends = 0;
+
+  double with_exceptions =
+    no_writers_burst(instances,
+                     [](rxcpp::observable<rti::sub::LoanedSample<ShapeType>> source) {
+                       return source >> rx4dds::instance_lifecycle();
+                     },
+                     [](const ShapeType &) { },
+                     [&errors](std::exception_ptr eptr) {
+                       try { std::rethrow_exception(eptr); }
+                       catch (rx4dds::NotAliveNoWriters &) { errors++; }
+                     });
+
+  double with_events =
+    no_writers_burst(instances,
+                     [](rxcpp::observable<rti::sub::LoanedSample<ShapeType>> source) {
+                       return source >> rx4dds::lifecycle_events();
+                     },
+                     [&ends](const rx4dds::LifecycleEvent<ShapeType> & event) {
+                       if (event.kind == rx4dds::LifecycleKind::NO_WRITERS)
+                         ends++;
+                     },
+                     [](std::exception_ptr) { });
+
+  printf("no_writers burst of %lu instances: %.2f msec with exceptions (%lld), %.2f msec with events (%lld)\n",
+         (unsigned long) instances, with_exceptions, errors, with_events, ends);
+}
+
+namespace {
+
+  template <class Pipeline>
+  double tap_pass(long long samples, Pipeline pipeline)
+  {
+    rxcpp::subjects::subject<int> subject;
+    volatile int sink = 0;
+
+    rxcpp::composite_subscription subscription =
+      pipeline(subject.get_observable())
+        .subscribe([&sink](int i) { sink = i; });
+
+    auto subscriber = subject.get_subscriber();
+
+    bench_clock::time_point start = bench_clock::now();
+    for (long long i = 0; i < samples; ++i)
+      subscriber.on_next((int) i);
+
+    double result = nanos_per_sample(start, bench_clock::now(), samples);
+    subscription.unsubscribe();
+    return result;
+  }
+
+} // anonymous namespace
+
+// Cost of a counting do_effect tap over a bare subject, with a noexcept
+// and with a potentially throwing callable.
+void bench_do_effect()
+{
+  const long long samples = 10000000;
+  long long count = 0;
+
+  double bare = 
+    tap_pass(samples, [](rxcpp::observable<int> source) { 
+      return source; 
+    });
+
+  double nothrow_tap = 
+    tap_pass(samples, [&count](rxcpp::observable<int> source) {
+      return source >> rx4dds::do_effect([&count](int &) noexcept { count++; });
+    });
+
+  double throwing_tap = 
+    tap_pass(samples, [&count](rxcpp::observable<int> source) {
+      return source >> rx4dds::do_effect([&count](int &) { count++; });
+    });
+
+  printf("do_effect: %.2f ns/sample bare, +%.2f ns noexcept tap, +%.2f ns guarded tap (%lld)\n",
+         bare, nothrow_tap - bare, throwing_tap - bare, count);
+
+  // The noexcept tap is meant to add under 2 ns per sample.
+  printf("do_effect: noexcept tap %s the 2 ns target\n", 
+         (nothrow_tap - bare < 2.0) ? "meets" : "MISSES");
+}
+
+namespace {
+
+  template <class PublishOp>
+  double publish_pass(const std::vector<ShapeType> & shapes, 
+                      long long samples, 
+                      PublishOp publish_op)
+  {
+    rxcpp::subjects::subject<ShapeType> subject;
+
+    rxcpp::composite_subscription subscription =
+      (subject.get_observable() >> publish_op).subscribe();
+
+    auto subscriber = subject.get_subscriber();
+
+    bench_clock::time_point start = bench_clock::now();
+    for (long long i = 0; i < samples; ++i)
+      subscriber.on_next(shapes[i % shapes.size()]);
+
+    double result = nanos_per_sample(start, bench_clock::now(), samples);
+    subscription.unsubscribe();
+    return result;
+  }
+
+} // anonymous namespace
+
+// publish_over_dds with plain write(t) against the variant that writes
+// with cached instance handles. The colors are 128 characters long, the
+// bound of the ShapeType key, and nobody subscribes to the topic.
+void bench_write_with_handle(int domain_id)
+{
+  const long long samples = 1000000;
+  const size_t instance_count = 64;
+
+  dds::domain::DomainParticipant participant(domain_id);
+  dds::topic::Topic<ShapeType> topic(participant, "RxBenchShape");
+  dds::pub::DataWriter<ShapeType> writer(dds::pub::Publisher(participant), topic);
+
+  std::vector<ShapeType> shapes;
+  for (size_t i = 0; i < instance_count; ++i)
+  {
+    char suffix[16];
+    sprintf(suffix, "%04u", (unsigned) i);
+    shapes.push_back(ShapeType(std::string(124, 'C') + suffix, (int) i, (int) i, 30));
+  }
+
+  double plain = 
+    publish_pass(shapes, samples, 
+                 rx4dds::publish_over_dds(writer, shapes[0]));
+
+  double cached = 
+    publish_pass(shapes, samples, 
+                 rx4dds::publish_over_dds(writer, shapes[0], 
+                   [](const ShapeType & shape) -> const dds::core::string & { return shape.color(); }));
+
+  printf("write_with_handle: %.2f ns/sample write(t), %.2f ns/sample write(t, handle) (%lu instances)\n",
+         plain, cached, (unsigned long) instance_count);
+}
+
+namespace {
+
+  void fill_large_shape(int i, ShapeTypeLarge & shape)
+  {
+    shape.color("LARGE");
+    shape.x(i);
+    shape.y(i);
+    shape.shapesize(30);
+    std::fill(shape.payload().begin(), shape.payload().end(), (uint8_t) i);
+  }
+
+  template <class Pipeline>
+  double large_write_pass(long long samples, Pipeline pipeline)
+  {
+    rxcpp::subjects::subject<int> subject;
+
+    rxcpp::composite_subscription subscription =
+      pipeline(subject.get_observable()).subscribe();
+
+    auto subscriber = subject.get_subscriber();
+
+    bench_clock::time_point start = bench_clock::now();
+    for (long long i = 0; i < samples; ++i)
+      subscriber.on_next((int) i);
+
+    double result = nanos_per_sample(start, bench_clock::now(), samples);
+    subscription.unsubscribe();
+    return result;
+  }
+
+} // anonymous namespace
+
+// 64 KB samples written by mapping to a new ShapeTypeLarge per value 
+// against filling one sample in place and, with Connext 6.0 or later, 
+// filling a sample loaned by the writer. A reader in a second participant
+// receives them, over SHMEM when both run on one host. The samples are
+// larger than a transport message, hence the asynchronous publisher.
+void bench_in_place_write(int domain_id)
+{
+  const long long samples = 20000;
+
+  dds::domain::DomainParticipant participant(domain_id);
+  dds::topic::Topic<ShapeTypeLarge> topic(participant, "RxBenchLargeShape");
+
+  dds::pub::qos::DataWriterQos writer_qos = 
+    dds::core::QosProvider::Default().datawriter_qos();
+  writer_qos << rti::core::policy::PublishMode::Asynchronous();
+
+  dds::pub::DataWriter<ShapeTypeLarge> writer(
+    dds::pub::Publisher(participant), topic, writer_qos);
+
+  dds::domain::DomainParticipant reader_participant(domain_id);
+  dds::topic::Topic<ShapeTypeLarge> reader_topic(reader_participant, "RxBenchLargeShape");
+  dds::sub::DataReader<ShapeTypeLarge> reader(
+    dds::sub::Subscriber(reader_participant), reader_topic);
+
+  ShapeTypeLarge instance;
+  fill_large_shape(-1, instance);
+
+  double copied =
+    large_write_pass(samples, [&writer, &instance](rxcpp::observable<int> source) {
+      return source.map([](int i) {
+                      ShapeTypeLarge shape;
+                      fill_large_shape(i, shape);
+                      return shape;
+                    })
+             >> rx4dds::publish_over_dds(writer, instance);
+    });
+
+  double in_place =
+    large_write_pass(samples, [&writer, &instance](rxcpp::observable<int> source) {
+      return source >> rx4dds::publish_in_place_over_dds(writer, instance, fill_large_shape);
+    });
+
+  printf("in_place_write: %.0f MB/s copied, %.0f MB/s in place (%lu-byte payload)\n",
+         65536 * 1000.0 / copied, 65536 * 1000.0 / in_place, 
+         (unsigned long) instance.payload().size());
+
+#if RX4DDS_HAVE_WRITER_LOAN
+  // The same fill, into a sample loaned by the writer. 
+  double loaned =
+    large_write_pass(samples, [&writer, &instance](rxcpp::observable<int> source) {
+      return source >> rx4dds::publish_loaned_over_dds(writer, instance, fill_large_shape);
+    });
+
+  printf("in_place_write: %.0f MB/s loaned\n", 65536 * 1000.0 / loaned);
+#else
+  printf("in_place_write: no loaned pass, DataWriter loans need Connext 6.0 or later\n");
+#endif
+}
+
+// TokenBucket against a range of target rates, half a second each.
+// Every rate is meant to be hit within 1%.
+void bench_pacing()
+{
+  const double rates[] = { 1e3, 1e4, 1e5, 1e6, 5e6 };
+  int misses = 0;
+
+  for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r)
+  {
+    rx4dds::TokenBucket bucket(rates[r]);
+    long long samples = std::max(500LL, (long long) (rates[r] / 2));
+
+    for (long long i = 0; i < samples; ++i)
+      bucket.acquire();
+
+    rx4dds::PacingStats stats = bucket.stats();
+    bool within = std::fabs(stats.error_percent) <= 1.0;
+    if (!within)
+      misses++;
+
+    printf("pacing: target %.0f/s, achieved %.1f/s (%+.3f%%), %llu sleeps%s\n",
+           stats.target_rate, stats.achieved_rate, stats.error_percent, stats.sleeps,
+           within ? "" : " MISSES 1%");
+  }
+
+  printf("pacing: %s the 1%% target at every rate (%d of %lu missed)\n",
+         misses ? "MISSES" : "meets", misses, 
+         (unsigned long) (sizeof(rates) / sizeof(rates[0])));
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Micro-benchmarks for rx4dds operators. They drive the operators 
+// through plain rxcpp subjects, so no DDS traffic is needed.
+
+void bench_window_aggregate();
+void bench_window_join();
+void bench_filter_expression();
+void bench_instance_lifecycle();
+void bench_no_writers_burst();
+void bench_do_effect();
+void bench_pacing();
+
+// Needs a DomainParticipant, but no remote readers.
+void bench_write_with_handle(int domain_id);
+void bench_in_place_write(int domain_id);
@@ -43,38 +43,32 @@ ShapeType SolarSystem::planet_location(const ShapeType & sun,
 rxcpp::composite_subscription SolarSystem::blue()
 {
   ShapeType blue_instance("BLUE", -1, -1, -1);
+  auto color = [](const ShapeType & shape) -> const dds::core::string & { return shape.color(); };
 
   // The Sun observable
   auto sun_orbit =
     topic_subscription_.create_observable()
-    >> rx4dds::complete_on_dispose()
-    >> rx4dds::error_on_no_alive_writers()
-    >> rxcpp::operators::filter([](rti::sub::LoanedSample<ShapeType> sample) {
-        return sample.info().valid();
-    })
-    >> rxcpp::operators::map([](rti::sub::LoanedSample<ShapeType> sample) {
-      return sample.data();
-    });
+    >> rx4dds::instance_lifecycle();
 
   // The Earth observable
   int earth_degree = 0;
   auto earth_orbit =
-    sun_orbit.map([earth_degree]( ShapeType & sun_loc) 
+    sun_orbit.map([earth_degree](const ShapeType & sun_loc) 
     {
       const_cast<int &>(earth_degree) = (earth_degree + 3) % 360;
       return SolarSystem::planet_location(sun_loc, earth_degree, "Earth");
   })
-  >> rx4dds::publish_over_dds(circle_writer_, blue_instance);
+  >> rx4dds::publish_over_dds(circle_writer_, blue_instance, color);
 
   // The Moon observable
   int moon_degree = 0;
   auto moon_orbit
-    = earth_orbit.map([moon_degree](const ShapeType earth_loc)
+    = earth_orbit.map([moon_degree](const ShapeType & earth_loc)
       {
         const_cast<int &>(moon_degree) = (moon_degree + 9) % 360;
         return SolarSystem::planet_location(earth_loc, moon_degree, "Moon");
       })
-      >> rx4dds::publish_over_dds(triangle_writer_, blue_instance);
+      >> rx4dds::publish_over_dds(triangle_writer_, blue_instance, color);
 
   return moon_orbit.subscribe();
 }
@@ -84,47 +78,57 @@ rxcpp::composite_subscription SolarSystem::multiple()
   auto solarsystem_stream =
     topic_subscription_.create_observable()
     >> rx4dds::group_by_dds_instance(
-        [](const ShapeType & shape) { return shape.color(); });
+        [](const ShapeType & shape) -> const dds::core::string & { return shape.color(); });
 
   typedef
     rxcpp::grouped_observable < dds::core::string, rti::sub::LoanedSample<ShapeType> >
       GroupedShapeObservable;
 
-  rxcpp::composite_subscription subscription =
+  typedef std::pair<dds::core::string, rxcpp::observable<ShapeType>> Orbit;
+
+  // One earth orbit per sun. It is shared by the circle writer and the
+  // moon orbit around it.
+  auto earth_orbits =
     solarsystem_stream
-    .flat_map([this](GroupedShapeObservable go)
+    .map([](GroupedShapeObservable go)
     {
-      ShapeType instance(go.get_key(), -1, -1, -1);
-
       auto sun_orbit =
         go  >> rx4dds::to_unkeyed()
-            >> rx4dds::error_on_no_alive_writers()
-            >> rx4dds::skip_invalid_samples()
-            >> rx4dds::map_samples_to_data();
+            >> rx4dds::instance_lifecycle<false, true, true, true>();
 
       int earth_degree = 0;
-      auto earth_orbit =
+      rxcpp::observable<ShapeType> earth_orbit =
         sun_orbit.map([earth_degree](const ShapeType & sun_loc) {
           const_cast<int &>(earth_degree) = (earth_degree + 3) % 360;
           return SolarSystem::planet_location(sun_loc, earth_degree, "Earth");
         })
-        >> rx4dds::publish_over_dds(circle_writer_, instance);
+        .publish()
+        .ref_count();
 
+      return Orbit(go.get_key(), earth_orbit);
+    })
+    .publish()
+    .ref_count();
+
+  auto moon_orbits =
+    earth_orbits
+    .map([](const Orbit & earth_orbit)
+    {
       int moon_degree = 0;
-      auto moon_orbit
-        = earth_orbit.map([moon_degree](const ShapeType & earth_loc)
-      {
-        const_cast<int &>(moon_degree) = (moon_degree + 9) % 360;
-        return SolarSystem::planet_location(earth_loc, moon_degree, "Moon");
-      });
-      
-      return moon_orbit
-        >> rx4dds::publish_over_dds(triangle_writer_, instance);
-    },
-    [](GroupedShapeObservable, const ShapeType &) {
-    return 0;
-  })
-  .subscribe();
+      rxcpp::observable<ShapeType> moon_orbit =
+        earth_orbit.second.map([moon_degree](const ShapeType & earth_loc) {
+          const_cast<int &>(moon_degree) = (moon_degree + 9) % 360;
+          return SolarSystem::planet_location(earth_loc, moon_degree, "Moon");
+        });
+
+      return Orbit(earth_orbit.first, moon_orbit);
+    });
+
+  rxcpp::composite_subscription subscription;
+  subscription.add(
+    (earth_orbits >> rx4dds::publish_grouped_over_dds(circle_writer_)).subscribe());
+  subscription.add(
+    (moon_orbits >> rx4dds::publish_grouped_over_dds(triangle_writer_)).subscribe());
 
   return subscription;
 }
@@ -0,0 +1,678 @@
+#pragma once
+
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <dds/core/ddscore.hpp>
+
+// C++ counterpart of the where-stages of javascript/rx4dds/filters.js:
+//
+//   has <path>                        hastype <word>
+//   contains <path> '<substring>'     notcontains <path> '<substring>'
+//   greater_than_equal <path> <value> greater_than <path> <value>
+//   less_than_equal <path> <value>    less_than <path> <value>
+//   equal <path> <value>              not_equal <path> <value>
+//   match {"<path>" : <value>, ...}   pass   block
+//
+// A rule (a list of stages, all of which must hold) is compiled against
+// a FilterSchema that maps field paths of an IDL type to their offsets.
+// Every numeric comparison becomes a range check (lo <= field <= hi, 
+// possibly negated) and the checks are kept in one flat array per field
+// type, so a FilterProgram is a few tight loops over plain structs: no 
+// std::function and no virtual call. The int32, int64, float and double
+// loops don't dispatch at all. Narrower integral and bool fields still
+// switch on their kind per check (load_int), and string checks switch
+// on their storage kind, their opcode and their comparison (test_string).
+
+namespace rx4dds {
+
+  enum class FieldKind
+  {
+    INT8, UINT8, INT16, UINT16, INT32, UINT32, INT64, UINT64,
+    FLOAT, DOUBLE, BOOL, C_STRING, STD_STRING, DDS_STRING
+  };
+
+  namespace detail {
+
+    template <class M, class Enable = void>
+    struct field_kind;
+
+    template <class M>
+    struct field_kind<M, typename std::enable_if<std::is_integral<M>::value && 
+                                                 !std::is_same<M, bool>::value>::type>
+    {
+      static const FieldKind value =
+        (sizeof(M) == 1) ? (std::is_signed<M>::value ? FieldKind::INT8  : FieldKind::UINT8)  :
+        (sizeof(M) == 2) ? (std::is_signed<M>::value ? FieldKind::INT16 : FieldKind::UINT16) :
+        (sizeof(M) == 4) ? (std::is_signed<M>::value ? FieldKind::INT32 : FieldKind::UINT32) :
+                           (std::is_signed<M>::value ? FieldKind::INT64 : FieldKind::UINT64);
+    };
+
+    template <class M>
+    struct field_kind<M, typename std::enable_if<std::is_enum<M>::value>::type>
+      : field_kind<typename std::underlying_type<M>::type>
+    { };
+
+    template <> struct field_kind<bool>   { static const FieldKind value = FieldKind::BOOL; };
+    template <> struct field_kind<float>  { static const FieldKind value = FieldKind::FLOAT; };
+    template <> struct field_kind<double> { static const FieldKind value = FieldKind::DOUBLE; };
+    template <> struct field_kind<char *> { static const FieldKind value = FieldKind::C_STRING; };
+    template <> struct field_kind<std::string> { static const FieldKind value = FieldKind::STD_STRING; };
+    template <> struct field_kind<dds::core::string> { static const FieldKind value = FieldKind::DDS_STRING; };
+
+    inline bool is_string_kind(FieldKind kind)
+    {
+      return (kind == FieldKind::C_STRING) || 
+             (kind == FieldKind::STD_STRING) || 
+             (kind == FieldKind::DDS_STRING);
+    }
+
+    inline bool is_floating_kind(FieldKind kind)
+    {
+      return (kind == FieldKind::FLOAT) || (kind == FieldKind::DOUBLE);
+    }
+
+    enum FilterComparison
+    {
+      LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, EQUAL, NOT_EQUAL
+    };
+
+    struct DoubleRangeCheck
+    {
+      size_t offset;
+      double lo;
+      double hi;
+      bool negate;
+
+      bool test(double value) const
+      {
+        return ((value >= lo) & (value <= hi)) != negate;
+      }
+    };
+
+    // Integral ranges take one unsigned comparison: below lo, value - lo
+    // wraps around past span. A range may wrap too, so not_equal c is 
+    // the range [c + 1, c - 1]. Signed fields are sign-extended and their
+    // bounds are signed; UINT64 fields and their bounds are taken as they
+    // are, so values past 2^63 still order above the rest.
+    struct IntRangeCheck
+    {
+      size_t offset;
+      unsigned long long lo;
+      unsigned long long span;
+      FieldKind kind;
+
+      bool test(unsigned long long value) const
+      {
+        return value - lo <= span;
+      }
+    };
+
+    enum StringOpcode
+    {
+      STRING_COMPARE,
+      STRING_CONTAINS,
+      STRING_NOT_CONTAINS
+    };
+
+    struct StringCheck
+    {
+      size_t offset;
+      FieldKind kind;
+      StringOpcode opcode;
+      FilterComparison comparison;
+      std::string operand;
+    };
+
+    inline unsigned long long load_int(const char * field, FieldKind kind)
+    {
+      switch (kind)
+      {
+        case FieldKind::INT8:   return (long long) *reinterpret_cast<const int8_t *>(field);
+        case FieldKind::UINT8:  return *reinterpret_cast<const uint8_t *>(field);
+        case FieldKind::INT16:  return (long long) *reinterpret_cast<const int16_t *>(field);
+        case FieldKind::UINT16: return *reinterpret_cast<const uint16_t *>(field);
+        case FieldKind::INT32:  return (long long) *reinterpret_cast<const int32_t *>(field);
+        case FieldKind::UINT32: return *reinterpret_cast<const uint32_t *>(field);
+        case FieldKind::INT64:  return (long long) *reinterpret_cast<const int64_t *>(field);
+        case FieldKind::UINT64: return *reinterpret_cast<const uint64_t *>(field);
+        case FieldKind::BOOL:   return *reinterpret_cast<const bool *>(field) ? 1 : 0;
+        default:                return 0;
+      }
+    }
+
+    inline const char * load_string(const char * field, FieldKind kind)
+    {
+      switch (kind)
+      {
+        case FieldKind::C_STRING:   
+        {
+          const char * str = *reinterpret_cast<char * const *>(field);
+          return str ? str : "";
+        }
+        case FieldKind::STD_STRING: return reinterpret_cast<const std::string *>(field)->c_str();
+        case FieldKind::DDS_STRING: return reinterpret_cast<const dds::core::string *>(field)->c_str();
+        default:                    return "";
+      }
+    }
+
+    inline bool test_string(const char * base, const StringCheck & check)
+    {
+      const char * value = load_string(base + check.offset, check.kind);
+
+      switch (check.opcode)
+      {
+        case STRING_CONTAINS:     
+          return strstr(value, check.operand.c_str()) != nullptr;
+        case STRING_NOT_CONTAINS: 
+          return strstr(value, check.operand.c_str()) == nullptr;
+        default:
+          break;
+      }
+
+      int order = strcmp(value, check.operand.c_str());
+      switch (check.comparison)
+      {
+        case LESS:          return order < 0;
+        case LESS_EQUAL:    return order <= 0;
+        case GREATER:       return order > 0;
+        case GREATER_EQUAL: return order >= 0;
+        case EQUAL:         return order == 0;
+        default:            return order != 0;
+      }
+    }
+
+  } // namespace detail
+
+  template <class T>
+  class FilterSchema
+  {
+  public:
+
+    struct Field
+    {
+      std::string path;
+      size_t offset;
+      FieldKind kind;
+    };
+
+    // Registers a field by its byte offset in T, e.g. 
+    // offsetof(SensorData, pos_x), for nested fields too ("pos.x").
+    FilterSchema & field(const std::string & path, size_t offset, FieldKind kind)
+    {
+      if (offset >= sizeof(T))
+        throw std::invalid_argument("FilterSchema: offset of '" + path + "' is outside the type");
+
+      Field f = { path, offset, kind };
+      fields_.push_back(f);
+      return *this;
+    }
+
+    // Registers a public data member, as in classic C++ IDL types.
+    template <class M>
+    FilterSchema & field(const std::string & path, M T::* member)
+    {
+      T probe;
+      return field(path, 
+                   reinterpret_cast<const char *>(&(probe.*member)) - reinterpret_cast<const char *>(&probe),
+                   detail::field_kind<M>::value);
+    }
+
+    // Registers a field through an accessor that returns a reference 
+    // into the object, such as the getters of modern C++ IDL types:
+    //   schema.field("x", [](const ShapeType & s) -> const int32_t & { return s.x(); });
+    // The accessor is called once, here; the program only keeps the offset.
+    template <class Accessor>
+    FilterSchema & field(const std::string & path, Accessor accessor)
+    {
+      typedef typename std::result_of<Accessor(const T &)>::type Result;
+      static_assert(std::is_reference<Result>::value, 
+                    "FilterSchema: the accessor must return a reference into the object");
+      typedef typename std::decay<Result>::type M;
+
+      T probe;
+      const M & member = accessor(static_cast<const T &>(probe));
+      return field(path,
+                   reinterpret_cast<const char *>(&member) - reinterpret_cast<const char *>(&probe),
+                   detail::field_kind<M>::value);
+    }
+
+    const Field * find(const std::string & path) const
+    {
+      for (auto & f : fields_)
+        if (f.path == path)
+          return &f;
+
+      return nullptr;
+    }
+
+  private:
+    std::vector<Field> fields_;
+  };
+
+  namespace detail {
+    struct FilterCompiler;
+  } // namespace detail
+
+  // Checks are grouped by field type and the groups run in a fixed 
+  // order; stages are side-effect free, so only their conjunction counts.
+  // The integral checks share one array: the 32-bit ones first, then
+  // the 64-bit ones, then the narrower kinds that go through load_int.
+  template <class T>
+  class FilterProgram
+  {
+    bool blocked_;
+    std::vector<detail::IntRangeCheck> int_checks_;
+    size_t int32_count_;
+    size_t int64_count_;
+    std::vector<detail::DoubleRangeCheck> float_checks_;
+    std::vector<detail::DoubleRangeCheck> double_checks_;
+    std::vector<detail::StringCheck> string_checks_;
+
+    friend struct detail::FilterCompiler;
+
+  public:
+
+    FilterProgram()
+      : blocked_(false),
+        int32_count_(0),
+        int64_count_(0)
+    { }
+
+    bool operator ()(const T & t) const
+    {
+      if (blocked_)
+        return false;
+
+      const char * base = reinterpret_cast<const char *>(&t);
+      const detail::IntRangeCheck * check = int_checks_.data();
+      const detail::IntRangeCheck * int32_end = check + int32_count_;
+      const detail::IntRangeCheck * int64_end = int32_end + int64_count_;
+      const detail::IntRangeCheck * int_end = check + int_checks_.size();
+
+      for (; check != int32_end; ++check)
+        if (!check->test((long long) *reinterpret_cast<const int32_t *>(base + check->offset)))
+          return false;
+
+      for (; check != int64_end; ++check)
+        if (!check->test(*reinterpret_cast<const uint64_t *>(base + check->offset)))
+          return false;
+
+      for (; check != int_end; ++check)
+        if (!check->test(detail::load_int(base + check->offset, check->kind)))
+          return false;
+
+      for (auto & check : float_checks_)
+        if (!check.test(*reinterpret_cast<const float *>(base + check.offset)))
+          return false;
+
+      for (auto & check : double_checks_)
+        if (!check.test(*reinterpret_cast<const double *>(base + check.offset)))
+          return false;
+
+      for (auto & check : string_checks_)
+        if (!detail::test_string(base, check))
+          return false;
+
+      return true;
+    }
+
+    size_t size() const
+    {
+      return int_checks_.size() +
+             float_checks_.size() + double_checks_.size() + string_checks_.size() +
+             (blocked_ ? 1 : 0);
+    }
+  };
+
+  namespace detail {
+
+    struct FilterCompiler
+    {
+      // Integral bounds of an operand that isn't an exact long long 
+      // (fractional, or out of range), clamped to what a field can hold.
+      static long long clamp_bound(double bound)
+      {
+        if (bound <= (double) std::numeric_limits<long long>::min())
+          return std::numeric_limits<long long>::min();
+        if (bound >= (double) std::numeric_limits<long long>::max())
+          return std::numeric_limits<long long>::max();
+        return (long long) bound;
+      }
+
+      template <class Program, class Field>
+      static void compare(Program & program, const Field * field, FilterComparison comparison, const std::string & value)
+      {
+        typedef std::numeric_limits<long long> int_limits;
+        typedef std::numeric_limits<double> double_limits;
+
+        // Same as filters.js: a field the type doesn't have never matches.
+        if (!field)
+        {
+          program.blocked_ = true;
+          return;
+        }
+
+        if (is_string_kind(field->kind))
+        {
+          StringCheck check = { field->offset, field->kind, STRING_COMPARE, comparison, value };
+          program.string_checks_.push_back(check);
+          return;
+        }
+
+        bool is_boolean = (field->kind == FieldKind::BOOL) && ((value == "true") || (value == "false"));
+        char * end = nullptr;
+        double number = is_boolean ? ((value == "true") ? 1 : 0) : strtod(value.c_str(), &end);
+        if (!is_boolean && (value.empty() || (*end != '\0')))
+        {
+          // A number never equals a word.
+          if (comparison != NOT_EQUAL)
+            program.blocked_ = true;
+
+          return;
+        }
+
+        if (is_floating_kind(field->kind))
+        {
+          DoubleRangeCheck check = 
+            { field->offset, -double_limits::infinity(), double_limits::infinity(), false };
+
+          switch (comparison)
+          {
+            case LESS:          check.hi = nextafter(number, -double_limits::infinity()); break;
+            case LESS_EQUAL:    check.hi = number; break;
+            case GREATER:       check.lo = nextafter(number, double_limits::infinity()); break;
+            case GREATER_EQUAL: check.lo = number; break;
+            default:            
+              check.lo = check.hi = number; 
+              check.negate = (comparison == NOT_EQUAL);
+          }
+
+          if (field->kind == FieldKind::FLOAT)
+            program.float_checks_.push_back(check);
+          else
+            program.double_checks_.push_back(check);
+          return;
+        }
+
+        if (field->kind == FieldKind::UINT64)
+        {
+          compare_uint64(program, field, comparison, value, number);
+          return;
+        }
+
+        long long lo = int_limits::min();
+        long long hi = int_limits::max();
+
+        // Integral operands are used as they are, beyond the 53 bits a 
+        // double holds exactly.
+        errno = 0;
+        long long exact = is_boolean ? (long long) number : strtoll(value.c_str(), nullptr, 10);
+        bool is_exact = is_boolean || 
+                        ((value.find_first_of(".eE") == std::string::npos) && (errno != ERANGE));
+
+        switch (comparison)
+        {
+          case LESS:
+            if (is_exact && (exact == int_limits::min()))
+            {
+              program.blocked_ = true;
+              return;
+            }
+            hi = is_exact ? exact - 1 : clamp_bound(std::ceil(number) - 1);
+            break;
+          case LESS_EQUAL:
+            hi = is_exact ? exact : clamp_bound(std::floor(number));
+            break;
+          case GREATER:
+            if (is_exact && (exact == int_limits::max()))
+            {
+              program.blocked_ = true;
+              return;
+            }
+            lo = is_exact ? exact + 1 : clamp_bound(std::floor(number) + 1);
+            break;
+          case GREATER_EQUAL:
+            lo = is_exact ? exact : clamp_bound(std::ceil(number));
+            break;
+          default:
+            if (!is_exact && ((std::floor(number) != number) || 
+                              (number >= 9223372036854775808.0) || (number < -9223372036854775808.0)))
+            {
+              // No integer equals a fractional or out of range operand.
+              if (comparison == EQUAL)
+                program.blocked_ = true;
+              return;
+            }
+            lo = hi = is_exact ? exact : clamp_bound(number);
+        }
+
+        if (lo > hi)
+        {
+          program.blocked_ = true;
+          return;
+        }
+
+        IntRangeCheck check = 
+          { field->offset, (unsigned long long) lo, (unsigned long long) hi - (unsigned long long) lo, field->kind };
+        if (comparison == NOT_EQUAL)
+        {
+          check.lo = (unsigned long long) lo + 1;
+          check.span = ~0ull - 1;
+        }
+
+        add_int_check(program, check);
+      }
+
+      // UINT64 fields compare in the unsigned domain, where an operand 
+      // below 0 is below every value and one past 2^64 - 1 above them all.
+      template <class Program, class Field>
+      static void compare_uint64(Program & program, const Field * field, FilterComparison comparison, 
+                                 const std::string & value, double number)
+      {
+        typedef std::numeric_limits<unsigned long long> uint_limits;
+
+        errno = 0;
+        bool is_exact = (value.find_first_of("-.eE") == std::string::npos);
+        unsigned long long x = is_exact ? strtoull(value.c_str(), nullptr, 10) : 0;
+        is_exact = is_exact && (errno != ERANGE);
+
+        if (!is_exact)
+        {
+          bool below = number < 0;
+          if (below || (number >= 18446744073709551616.0))
+          {
+            bool all = (comparison == NOT_EQUAL) ||
+                       (below ? ((comparison == GREATER) || (comparison == GREATER_EQUAL))
+                              : ((comparison == LESS) || (comparison == LESS_EQUAL)));
+            if (!all)
+              program.blocked_ = true;
+            return;
+          }
+
+          x = (unsigned long long) std::floor(number);
+          if (std::floor(number) != number)
+          {
+            // Between x and x + 1: only the direction of the comparison counts.
+            switch (comparison)
+            {
+              case LESS:          comparison = LESS_EQUAL; break;
+              case GREATER_EQUAL: comparison = GREATER; break;
+              case EQUAL:         program.blocked_ = true; return;
+              case NOT_EQUAL:     return;
+              default:            break;
+            }
+          }
+        }
+
+        unsigned long long lo = 0;
+        unsigned long long hi = uint_limits::max();
+
+        switch (comparison)
+        {
+          case LESS:
+            if (x == 0)
+            {
+              program.blocked_ = true;
+              return;
+            }
+            hi = x - 1;
+            break;
+          case LESS_EQUAL:    hi = x; break;
+          case GREATER:
+            if (x == uint_limits::max())
+            {
+              program.blocked_ = true;
+              return;
+            }
+            lo = x + 1;
+            break;
+          case GREATER_EQUAL: lo = x; break;
+          default:            lo = hi = x;
+        }
+
+        IntRangeCheck check = { field->offset, lo, hi - lo, field->kind };
+        if (comparison == NOT_EQUAL)
+        {
+          check.lo = x + 1;
+          check.span = uint_limits::max() - 1;
+        }
+
+        add_int_check(program, check);
+      }
+
+      template <class Program>
+      static void add_int_check(Program & program, const IntRangeCheck & check)
+      {
+        auto & checks = program.int_checks_;
+
+        switch (check.kind)
+        {
+          case FieldKind::INT32: 
+            checks.insert(checks.begin() + program.int32_count_++, check); 
+            break;
+          case FieldKind::INT64: 
+          case FieldKind::UINT64:
+            checks.insert(checks.begin() + program.int32_count_ + program.int64_count_++, check); 
+            break;
+          default:               
+            checks.push_back(check);
+        }
+      }
+
+      template <class Program, class Field>
+      static void contains(Program & program, const Field * field, const std::string & substring, bool negate)
+      {
+        if (!field || !is_string_kind(field->kind))
+          throw std::invalid_argument("compile_filter: contains/notcontains needs a string field");
+
+        StringCheck check = 
+          { field->offset, field->kind, negate ? STRING_NOT_CONTAINS : STRING_CONTAINS, EQUAL, substring };
+        program.string_checks_.push_back(check);
+      }
+
+      template <class Program>
+      static void block(Program & program)
+      {
+        program.blocked_ = true;
+      }
+      // Parses the flat JSON object of a match stage into equalities.
+      template <class Program, class Schema>
+      static void match(Program & program, const Schema & schema, const std::string & json)
+      {
+        const std::regex object("^\\s*\\{(.*)\\}\\s*$");
+        const std::regex member(
+          "\\s*\"([^\"]*)\"\\s*:\\s*(\"([^\"]*)\"|[-+\\w\\.]+)\\s*(,|$)");
+
+        std::smatch parts;
+        if (!std::regex_match(json, parts, object))
+          throw std::invalid_argument("compile_filter: parsing 'match JSON' failed: " + json);
+
+        std::string members = parts[1];
+        for (std::sregex_iterator it(members.begin(), members.end(), member), end; it != end; ++it)
+        {
+          const std::smatch & m = *it;
+          std::string value = m[3].matched ? m[3].str() : m[2].str();
+          compare(program, schema.find(m[1]), EQUAL, value);
+        }
+      }
+    };
+
+  } // namespace detail
+
+  // Compiles a list of where-stages, in the filters.js syntax, into a 
+  // predicate over T. Stages that aren't predicates (insert, groupby, 
+  // ...) are rejected with std::invalid_argument. The patterns are built
+  // on every call rather than kept in function-local statics, whose 
+  // initialization VS2013 does not make thread-safe; rules are compiled
+  // once, so that costs nothing where it matters.
+  template <class T>
+  FilterProgram<T> compile_filter(const std::vector<std::string> & stages, const FilterSchema<T> & schema)
+  {
+    const std::regex has("^\\s*(has)\\s+([\\w\\.]+)\\s*$", std::regex::icase);
+    const std::regex hastype("^\\s*(hastype)\\s+(\\w+)\\s*$", std::regex::icase);
+    const std::regex contains("^\\s*(contains)\\s+([\\w\\.]+)\\s+'(.*)'\\s*$", std::regex::icase);
+    const std::regex notcontains("^\\s*(notcontains)\\s+([\\w\\.]+)\\s+'(.*)'\\s*$", std::regex::icase);
+    const std::regex pass("^\\s*(pass)\\s*$", std::regex::icase);
+    const std::regex block("^\\s*(block)\\s*$", std::regex::icase);
+    const std::regex comparer(
+      "^\\s*(greater_than_equal|greater_than|less_than_equal|less_than|not_equal|equal)"
+      "\\s+([\\w\\.]+)\\s+([-\\w\\.]+)\\s*$", std::regex::icase);
+    const std::regex match("^\\s*(match)\\s+(\\{.*\\})\\s*$", std::regex::icase);
+
+    typedef detail::FilterCompiler compiler;
+    FilterProgram<T> program;
+
+    for (const std::string & stage : stages)
+    {
+      std::smatch arr;
+
+      if (std::regex_match(stage, arr, has))
+      {
+        if (!schema.find(arr[2]))
+          compiler::block(program);
+      }
+      else if (std::regex_match(stage, arr, hastype))
+        compiler::compare(program, schema.find("type"), detail::EQUAL, arr[2]);
+      else if (std::regex_match(stage, arr, contains))
+        compiler::contains(program, schema.find(arr[2]), arr[3], false);
+      else if (std::regex_match(stage, arr, notcontains))
+        compiler::contains(program, schema.find(arr[2]), arr[3], true);
+      else if (std::regex_match(stage, arr, pass))
+        continue;
+      else if (std::regex_match(stage, arr, block))
+        compiler::block(program);
+      else if (std::regex_match(stage, arr, comparer))
+      {
+        std::string op = arr[1];
+        for (auto & c : op)
+          c = (char) tolower(c);
+
+        detail::FilterComparison comparison =
+          (op == "greater_than_equal") ? detail::GREATER_EQUAL :
+          (op == "greater_than")       ? detail::GREATER :
+          (op == "less_than_equal")    ? detail::LESS_EQUAL :
+          (op == "less_than")          ? detail::LESS :
+          (op == "not_equal")          ? detail::NOT_EQUAL :
+                                         detail::EQUAL;
+
+        compiler::compare(program, schema.find(arr[2]), comparison, arr[3]);
+      }
+      else if (std::regex_match(stage, arr, match))
+        compiler::match(program, schema, arr[2]);
+      else
+        throw std::invalid_argument("compile_filter: not a predicate stage: '" + stage + "'");
+    }
+
+    return program;
+  }
+
+} // namespace rx4dds
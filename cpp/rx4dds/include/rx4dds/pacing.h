@@ -0,0 +1,226 @@
+#pragma once
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+// steady_clock of VS2012/2013 is the system clock, at its resolution;
+// timeBeginPeriod() is in winmm.
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <mmsystem.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "winmm.lib")
+#endif
+#endif
+
+// Rate pacing with no dependency on DDS, for the soccer publisher as
+// well as for rx4dds::pace().
+
+namespace rx4dds {
+
+  // Nanoseconds on a monotonic clock.
+  inline long long pacing_now_ns()
+  {
+#if defined(_MSC_VER) && (_MSC_VER < 1900)
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0)
+      QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return (counter.QuadPart / frequency.QuadPart) * 1000000000LL +
+           (counter.QuadPart % frequency.QuadPart) * 1000000000LL / frequency.QuadPart;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+#if defined(_WIN32)
+  // Raises the resolution of the Windows timer, and so of Sleep(), to
+  // 1 ms for as long as one of these exists.
+  class TimerResolution
+  {
+  public:
+    TimerResolution()
+    {
+      timeBeginPeriod(1);
+    }
+
+    TimerResolution(const TimerResolution &)
+    {
+      timeBeginPeriod(1);
+    }
+
+    TimerResolution & operator = (const TimerResolution &)
+    {
+      return *this;
+    }
+
+    ~TimerResolution()
+    {
+      timeEndPeriod(1);
+    }
+  };
+#endif
+
+  struct PacingStats
+  {
+    unsigned long long samples;
+    unsigned long long sleeps;
+    double elapsed_seconds;  // from the first to the last sample
+    double target_rate;
+    double achieved_rate;
+    double error_percent;    // of achieved_rate against target_rate
+  };
+
+  // A token bucket that hands out rate tokens per second, on a 
+  // schedule kept from the first acquire(), so that oversleeping 
+  // delays tokens but never lowers the long-run rate. acquire() hands 
+  // out the tokens due within the batch window right away and sleeps 
+  // for the others, so at rates above one token per window tokens go
+  // out in batches with one sleep between two batches, instead of 
+  // spinning for each. With a spin threshold, the last part of a sleep
+  // is spun instead, for tokens spaced more evenly at the cost of a 
+  // core. Tokens not taken while the caller was busy are kept, up to 
+  // burst of them, so a late sample doesn't lower the long-run rate.
+  class TokenBucket
+  {
+    double rate_;
+    double period_ns_;
+    double burst_ns_;
+    long long batch_ns_;
+    long long spin_ns_;
+
+    long long start_ns_;
+    long long last_ns_;
+    double next_ns_;      // when the next token is due, from start_ns_
+    bool started_;
+    unsigned long long acquired_;
+    unsigned last_tokens_;
+    unsigned long long sleeps_;
+
+#if defined(_WIN32)
+    TimerResolution timer_resolution_;
+#endif
+
+  public:
+
+    // burst defaults to 10 ms worth of tokens, at least 1.
+    explicit TokenBucket(double rate, double burst = 0)
+      : rate_(rate),
+        period_ns_(0),
+        burst_ns_(0),
+#if defined(_WIN32)
+        batch_ns_(2000000), // a 1 ms timer tick, and the sleep past it
+#else
+        batch_ns_(200000),
+#endif
+        spin_ns_(0),
+        start_ns_(0),
+        last_ns_(0),
+        next_ns_(0),
+        started_(false),
+        acquired_(0),
+        last_tokens_(0),
+        sleeps_(0)
+    {
+      if (!(rate > 0))
+        throw std::invalid_argument("TokenBucket: rate must be positive");
+
+      period_ns_ = 1e9 / rate;
+
+      if (burst <= 0)
+        burst = rate / 100;
+      if (burst < 1)
+        burst = 1;
+
+      burst_ns_ = burst * period_ns_;
+    }
+
+    // How early a token may be handed out rather than slept for. 
+    // Shorter than the timer resolution, it turns the sleeps into 
+    // spins.
+    void batch_window(long long nanosecs)
+    {
+      batch_ns_ = nanosecs;
+    }
+
+    // How close to a token acquire() stops sleeping and spins; 0, the
+    // default, never spins.
+    void spin_threshold(long long nanosecs)
+    {
+      spin_ns_ = nanosecs;
+    }
+
+    void acquire(unsigned tokens = 1)
+    {
+      long long now = pacing_now_ns();
+      if (!started_)
+      {
+        start_ns_ = now;
+        started_ = true;
+      }
+
+      double elapsed = (double) (now - start_ns_);
+      if (next_ns_ < elapsed - burst_ns_)
+        next_ns_ = elapsed - burst_ns_;
+
+      if (next_ns_ - elapsed > batch_ns_)
+      {
+        long long wait = (long long) (next_ns_ - elapsed);
+        if (wait > spin_ns_)
+        {
+          std::this_thread::sleep_for(std::chrono::nanoseconds(wait - spin_ns_));
+          sleeps_++;
+        }
+        now = pacing_now_ns();
+        elapsed = (double) (now - start_ns_);
+
+        while ((spin_ns_ > 0) && (next_ns_ > elapsed))
+        {
+          now = pacing_now_ns();
+          elapsed = (double) (now - start_ns_);
+        }
+      }
+
+      next_ns_ += tokens * period_ns_;
+      last_ns_ = now;
+      acquired_ += tokens;
+      last_tokens_ = tokens;
+    }
+
+    // Takes the tokens only if acquire() wouldn't wait for them.
+    bool try_acquire(unsigned tokens = 1)
+    {
+      long long now = pacing_now_ns();
+      if (started_ && (next_ns_ - (double) (now - start_ns_) > batch_ns_))
+        return false;
+
+      acquire(tokens);
+      return true;
+    }
+
+    PacingStats stats() const
+    {
+      PacingStats stats;
+      stats.samples = acquired_;
+      stats.sleeps = sleeps_;
+      stats.elapsed_seconds = (last_ns_ - start_ns_) / 1e9;
+      stats.target_rate = rate_;
+      // The tokens of the last acquire() are due after last_ns_.
+      stats.achieved_rate =
+        ((acquired_ > last_tokens_) && (last_ns_ > start_ns_)) 
+          ? (acquired_ - last_tokens_) / stats.elapsed_seconds : 0;
+      stats.error_percent =
+        (stats.achieved_rate > 0) ? 100 * (stats.achieved_rate - rate_) / rate_ : 0;
+      return stats;
+    }
+  };
+
+} // namespace rx4dds
@@ -4,6 +4,13 @@
 #include <dds/core/ddscore.hpp>
 #include <dds/core/cond/StatusCondition.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -11,28 +18,36 @@
 #include <functional>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <set>
 
 #include "rxcpp/rx.hpp"
+#include "pacing.h"
+
+// DataWriter::get_loan() appeared in Connext 6.0, for FlatData and 
+// zero-copy (SHMEM_REF) types.
+#if defined(RTI_DDS_VERSION_MAJOR) && (RTI_DDS_VERSION_MAJOR >= 6)
+#define RX4DDS_HAVE_WRITER_LOAN 1
+#else
+#define RX4DDS_HAVE_WRITER_LOAN 0
+#endif
 
 namespace std
 {
   template <>
   struct hash<dds::core::InstanceHandle>
   {
-  private:
-    std::string handle_;
-
-  public:
-    hash()
-    {
-      handle_.resize(64);
-    }
-
+    // Hashes the key hash bytes of the handle. Formatting the handle 
+    // into a string on every lookup was slow, and hashed the empty 
+    // buffer rather than the formatted handle.
     std::size_t operator()(const dds::core::InstanceHandle& ihandle) const
     {
-      std::ostringstream out(handle_);
-      out << ihandle;
-      return std::hash<std::string>()(handle_);
+      const DDS_KeyHash_t & key_hash = ihandle->native().keyHash;
+      std::size_t hash = 2166136261u;
+      for (unsigned i = 0; (i < key_hash.length) && (i < sizeof(key_hash.value)); ++i)
+        hash = (hash ^ key_hash.value[i]) * 16777619u;
+      return hash;
     }
   };
 
@@ -40,9 +55,14 @@ namespace std
   template <>
   struct hash<dds::core::string>
   {
+    // Hashes the characters, not the pointer: equal strings held in 
+    // different samples must land in the same bucket.
     std::size_t operator()(const dds::core::string& str) const
     {
-      return std::hash<const char *>()(str.c_str());
+      std::size_t hash = 2166136261u;
+      for (const char * c = str.c_str(); *c; ++c)
+        hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+      return hash;
     }
 
   };
@@ -147,14 +167,458 @@ namespace rx4dds {
     rti::core::status::DataReaderProtocolStatus       datareader_protocol_status;
   };
 
+  // How far behind a reliable DataWriter is, as seen by the last 
+  // WriterBackpressure::poll().
+  struct WriterPressure
+  {
+    long long unacknowledged_samples; // ReliableWriterCacheChangedStatus
+    long long cache_samples;          // DataWriterCacheStatus
+    bool congested;
+  };
+
+  // An element of an event-time stream: either a data element stamped
+  // with its event time or a watermark. A watermark with timestamp w 
+  // promises that no data element with an earlier timestamp follows.
+  template <class T>
+  struct Timestamped
+  {
+    typedef T value_type;
+
+    long long timestamp;
+    bool is_watermark;
+    T value;
+
+    Timestamped()
+      : timestamp(0),
+        is_watermark(false),
+        value()
+    { }
+
+    Timestamped(long long ts, const T & v)
+      : timestamp(ts),
+        is_watermark(false),
+        value(v)
+    { }
+
+    static Timestamped watermark(long long ts)
+    {
+      Timestamped w;
+      w.timestamp = ts;
+      w.is_watermark = true;
+      return w;
+    }
+  };
+
+  // Result of an event-time window covering [start, end).
+  template <class Seed>
+  struct EventWindow
+  {
+    long long start;
+    long long end;
+    Seed value;
+  };
+
+  enum class LifecycleKind
+  {
+    DATA,
+    DISPOSED,
+    NO_WRITERS
+  };
+
+  // An element of a per-instance stream that carries the end of the 
+  // instance as a value: DISPOSED and NO_WRITERS are the last element 
+  // before on_completed, where error_on_no_alive_writers() would have
+  // raised a NotAliveNoWriters exception.
+  template <class T>
+  struct LifecycleEvent
+  {
+    typedef T value_type;
+
+    LifecycleKind kind;
+    T value;
+
+    LifecycleEvent()
+      : kind(LifecycleKind::DATA),
+        value()
+    { }
+
+    explicit LifecycleEvent(const T & v)
+      : kind(LifecycleKind::DATA),
+        value(v)
+    { }
+
+    static LifecycleEvent end(LifecycleKind k)
+    {
+      LifecycleEvent e;
+      e.kind = k;
+      return e;
+    }
+
+    bool is_data() const
+    {
+      return kind == LifecycleKind::DATA;
+    }
+  };
+
+  enum class InstanceEventKind
+  {
+    NEW,        // first sample of an instance never seen before
+    ALIVE,      // writers are back after NO_WRITERS
+    DISPOSED,
+    NO_WRITERS,
+    REBORN      // first sample of an instance after it was disposed
+  };
+
+  // Emitted by group_by_dds_instance(...).instance_events(). The 
+  // generation of an instance starts at 0 and is incremented each time 
+  // it is reborn, so per-instance state can be kept across a dispose 
+  // and told apart by (handle, generation). It is the DataReader's 
+  // disposed generation count, so it starts over if the reader purges
+  // the instance.
+  template <class Key>
+  struct InstanceEvent
+  {
+    InstanceEventKind kind;
+    Key key;
+    dds::core::InstanceHandle handle;
+    unsigned long long generation;
+  };
+
+  // What publish_over_dds_async() does when its queue is full.
+  enum class OverflowPolicy
+  {
+    BLOCK,                // wait for the writer thread
+    DROP_OLDEST,
+    CONFLATE_PER_INSTANCE // replace the queued sample of the same instance;
+                          // a new instance drops the oldest when full
+  };
+
+  // What publish_grouped_over_dds() does to the instance of a grouped
+  // stream that has ended.
+  enum class InstanceEndPolicy
+  {
+    DISPOSE,
+    UNREGISTER
+  };
+
+  // Counters kept by reorder_by_timestamp(). Distances are in 
+  // timestamp units: how far behind the newest timestamp seen so far a
+  // sample was when it arrived. All the subscriptions of the operator
+  // count into the same stats, possibly from several threads.
+  struct ReorderStats
+  {
+    std::atomic<unsigned long long> received;
+    std::atomic<unsigned long long> released;
+    std::atomic<unsigned long long> reordered;
+    std::atomic<unsigned long long> dropped;
+    std::atomic<unsigned long long> forced_releases;
+    std::atomic<long long> max_reorder_distance;
+
+    ReorderStats()
+      : received(0),
+        released(0),
+        reordered(0),
+        dropped(0),
+        forced_releases(0),
+        max_reorder_distance(0)
+    { }
+  };
+
+  // Bits of Sample<T>::flags().
+  enum SampleFlags
+  {
+    SAMPLE_VALID      = 0x01,
+    SAMPLE_NOT_READ   = 0x02,
+    SAMPLE_NEW_VIEW   = 0x04,
+    SAMPLE_DISPOSED   = 0x08,
+    SAMPLE_NO_WRITERS = 0x10
+  };
+
+  namespace detail {
+
+    // Nanoseconds in a dds::core::Time or a dds::core::Duration.
+    template <class TimeOrDuration>
+    long long to_nanosecs(const TimeOrDuration & time)
+    {
+      return time.sec() * 1000000000LL + time.nanosec();
+    }
+
+    inline dds::core::Duration from_nanosecs(long long nanosecs)
+    {
+      return dds::core::Duration((int32_t) (nanosecs / 1000000000LL), 
+                                 (uint32_t) (nanosecs % 1000000000LL));
+    }
+
+    inline unsigned char decode_sample_flags(const dds::sub::SampleInfo & info)
+    {
+      const dds::sub::status::DataState & state = info.state();
+      unsigned char flags = info.valid() ? SAMPLE_VALID : 0;
+
+      if (state.sample_state() == dds::sub::status::SampleState::not_read())
+        flags |= SAMPLE_NOT_READ;
+      if (state.view_state() == dds::sub::status::ViewState::new_view())
+        flags |= SAMPLE_NEW_VIEW;
+      if (state.instance_state() == dds::sub::status::InstanceState::not_alive_disposed())
+        flags |= SAMPLE_DISPOSED;
+      else if (state.instance_state() == dds::sub::status::InstanceState::not_alive_no_writers())
+        flags |= SAMPLE_NO_WRITERS;
+
+      return flags;
+    }
+
+  } // namespace detail
+
+  // A sample whose SampleInfo is decoded once, when it is taken, into 
+  // the fields the rx4dds operators look at. Like the LoanedSample it
+  // is made from, the data is only valid during on_next, unless the 
+  // sample comes from owned(), which copies the data.
+  template <class T>
+  class Sample
+  {
+    const T * data_;
+    std::shared_ptr<const T> owned_data_;
+    dds::core::InstanceHandle instance_handle_;
+    long long source_timestamp_;
+    long long reception_timestamp_;
+    int32_t disposed_generation_;
+    unsigned char flags_;
+
+  public:
+    typedef T DataType;
+
+    Sample()
+      : data_(nullptr),
+        instance_handle_(dds::core::InstanceHandle::nil()),
+        source_timestamp_(0),
+        reception_timestamp_(0),
+        disposed_generation_(0),
+        flags_(0)
+    { }
+
+    explicit Sample(const rti::sub::LoanedSample<T> & sample)
+      : data_(&sample.data()),
+        instance_handle_(sample.info().instance_handle()),
+        source_timestamp_(detail::to_nanosecs(sample.info().source_timestamp())),
+        reception_timestamp_(detail::to_nanosecs(sample.info()->reception_timestamp())),
+        disposed_generation_(sample.info().generation_count().disposed()),
+        flags_(detail::decode_sample_flags(sample.info()))
+    { }
+
+    // A copy of this sample that keeps the data alive on its own, for 
+    // operators that hold samples past on_next. Copies of the result 
+    // share the data.
+    Sample owned() const
+    {
+      Sample copy(*this);
+      if (!owned_data_ && data_)
+      {
+        copy.owned_data_ = std::make_shared<T>(*data_);
+        copy.data_ = copy.owned_data_.get();
+      }
+      return copy;
+    }
+
+    const T & data() const { return *data_; }
+    const dds::core::InstanceHandle & instance_handle() const { return instance_handle_; }
+
+    // Nanoseconds since the epoch.
+    long long source_timestamp() const { return source_timestamp_; }
+    long long reception_timestamp() const { return reception_timestamp_; }
+
+    // How many times the instance was reborn after a dispose.
+    int32_t disposed_generation() const { return disposed_generation_; }
+
+    unsigned char flags() const { return flags_; }
+    bool valid() const { return (flags_ & SAMPLE_VALID) != 0; }
+    bool alive() const { return (flags_ & (SAMPLE_DISPOSED | SAMPLE_NO_WRITERS)) == 0; }
+  };
+
   namespace detail {
 
+    // The built-in operators read samples through these, so they take
+    // either a LoanedSample or a pre-decoded Sample.
+    template <class T>
+    unsigned char sample_flags(const rti::sub::LoanedSample<T> & sample)
+    {
+      return decode_sample_flags(sample.info());
+    }
+
+    template <class T>
+    unsigned char sample_flags(const Sample<T> & sample)
+    {
+      return sample.flags();
+    }
+
+    template <class T>
+    bool sample_valid(const rti::sub::LoanedSample<T> & sample)
+    {
+      return sample.info().valid();
+    }
+
+    template <class T>
+    bool sample_valid(const Sample<T> & sample)
+    {
+      return sample.valid();
+    }
+
+    template <class T>
+    dds::core::InstanceHandle sample_instance_handle(const rti::sub::LoanedSample<T> & sample)
+    {
+      return sample.info().instance_handle();
+    }
+
+    template <class T>
+    const dds::core::InstanceHandle & sample_instance_handle(const Sample<T> & sample)
+    {
+      return sample.instance_handle();
+    }
+
+    template <class T>
+    long long sample_source_timestamp(const rti::sub::LoanedSample<T> & sample)
+    {
+      return to_nanosecs(sample.info().source_timestamp());
+    }
+
+    template <class T>
+    long long sample_source_timestamp(const Sample<T> & sample)
+    {
+      return sample.source_timestamp();
+    }
+
+    template <class T>
+    int32_t sample_disposed_generation(const rti::sub::LoanedSample<T> & sample)
+    {
+      return sample.info().generation_count().disposed();
+    }
+
+    template <class T>
+    int32_t sample_disposed_generation(const Sample<T> & sample)
+    {
+      return sample.disposed_generation();
+    }
+
+    // What an operator keeps of an element it holds past on_next: the 
+    // element itself, except for samples, whose data is on loan only 
+    // until take() returns. Those are kept as owned Sample<T>s.
+    template <class T>
+    struct owned_value
+    {
+      typedef T type;
+
+      static const T & make(const T & t) 
+      { 
+        return t; 
+      }
+    };
+
+    template <class T>
+    struct owned_value<rti::sub::LoanedSample<T>>
+    {
+      typedef Sample<T> type;
+
+      static Sample<T> make(const rti::sub::LoanedSample<T> & sample)
+      {
+        return Sample<T>(sample).owned();
+      }
+    };
+
+    template <class T>
+    struct owned_value<Sample<T>>
+    {
+      typedef Sample<T> type;
+
+      static Sample<T> make(const Sample<T> & sample)
+      {
+        return sample.owned();
+      }
+    };
+
+    // Per-instance throttling on the application side: forwards a valid
+    // sample only if its source timestamp is at least minimum_separation
+    // after the last one forwarded for the same instance. Samples that
+    // only carry instance state changes always go through, and drop the
+    // instance's entry once it is disposed or has no writers.
+    class ThrottlePerInstanceOp
+    {
+      dds::core::Duration minimum_separation_;
+      std::shared_ptr<const std::atomic<long long>> pushed_down_;
+
+    public:
+
+      explicit ThrottlePerInstanceOp(const dds::core::Duration & minimum_separation)
+        : minimum_separation_(minimum_separation)
+      { }
+
+      const dds::core::Duration & minimum_separation() const
+      {
+        return minimum_separation_;
+      }
+
+      // The same throttle, behind a DataReader whose TIME_BASED_FILTER
+      // separation is published in *applied_separation. While that is
+      // at least minimum_separation the middleware has already thinned
+      // the samples out, and checking again here would only drop the 
+      // ones that arrive a little early because of clock jitter.
+      ThrottlePerInstanceOp pushed_down_to(
+        const std::shared_ptr<const std::atomic<long long>> & applied_separation) const
+      {
+        ThrottlePerInstanceOp throttle(*this);
+        throttle.pushed_down_ = applied_separation;
+        return throttle;
+      }
+
+      template <class Observable>
+      rxcpp::observable<typename Observable::value_type> operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type LoanedSample;
+        typedef std::unordered_map<dds::core::InstanceHandle, long long> LastForwardedMap;
+
+        long long separation = to_nanosecs(minimum_separation_);
+        std::shared_ptr<const std::atomic<long long>> pushed_down = pushed_down_;
+
+        return rxcpp::observable<>::create<LoanedSample>(
+          [prev, separation, pushed_down](rxcpp::subscriber<LoanedSample> subscriber)
+        {
+          auto last_forwarded = std::make_shared<LastForwardedMap>();
+
+          return prev.subscribe(
+            [subscriber, last_forwarded, separation, pushed_down](const LoanedSample & sample)
+          {
+            unsigned char flags = sample_flags(sample);
+            if (!(flags & SAMPLE_VALID))
+            {
+              if (flags & (SAMPLE_DISPOSED | SAMPLE_NO_WRITERS))
+                last_forwarded->erase(sample_instance_handle(sample));
+
+              subscriber.on_next(sample);
+              return;
+            }
+
+            long long now = sample_source_timestamp(sample);
+            auto inserted = last_forwarded->emplace(sample_instance_handle(sample), now);
+
+            bool filtered = 
+              pushed_down && (pushed_down->load(std::memory_order_relaxed) >= separation);
+
+            if (inserted.second || filtered || (now - inserted.first->second >= separation))
+            {
+              inserted.first->second = now;
+              subscriber.on_next(sample);
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber]() { subscriber.on_completed(); });
+        });
+      }
+    };
+
     template <class T>
     struct SubscriptionState
     {
       bool init_dr_done_;
       bool init_read_condition_done_;
       bool init_status_condition_done_;
+      bool paused_;
 
       dds::domain::DomainParticipant participant_;
       std::string topic_name_;
@@ -165,8 +629,20 @@ namespace rx4dds {
       dds::core::cond::StatusCondition status_condition_;
       rxcpp::schedulers::worker worker_;
       rxcpp::subjects::subject<rti::sub::LoanedSample<T>> data_subject_;
+      rxcpp::subjects::subject<Sample<T>> sample_subject_;
       rxcpp::subjects::subject<rx4dds::StatusSet> status_subject_;
 
+      // Subscribers that need every sample vs. the minimum separations
+      // (in nanoseconds) asked for by throttled subscribers. The reader's
+      // TIME_BASED_FILTER can only be as coarse as the least demanding one.
+      // Subscribers come and go on whatever thread subscribes, hence the
+      // lock; applied_separation_ is read by the throttles on every sample.
+      std::mutex consumers_mutex_;
+      size_t unthrottled_consumers_;
+      std::multiset<long long> throttled_consumers_;
+      long long requested_separation_;
+      std::atomic<long long> applied_separation_;
+
       SubscriptionState(dds::domain::DomainParticipant part,
                         const std::string & topic_name,
                         dds::core::cond::WaitSet wait_set,
@@ -174,6 +650,7 @@ namespace rx4dds {
         : init_dr_done_(false),
           init_read_condition_done_(false),
           init_status_condition_done_(false),
+          paused_(false),
           participant_(part),
           topic_name_(topic_name),
           topic_(dds::core::null),
@@ -181,12 +658,15 @@ namespace rx4dds {
           wait_set_(wait_set),
           read_condition_(dds::core::null),
           status_condition_(dds::core::null),
-          worker_(worker)
+          worker_(worker),
+          unthrottled_consumers_(0),
+          requested_separation_(0),
+          applied_separation_(0)
       { }
 
       ~SubscriptionState()
       {
-        if (init_read_condition_done_)
+        if (init_read_condition_done_ && !paused_)
           wait_set_ -= read_condition_;
 
         if (init_status_condition_done_)
@@ -202,6 +682,75 @@ namespace rx4dds {
           init_dr_done_ = true;
         }
       }
+
+      void add_consumer(long long separation)
+      {
+        std::lock_guard<std::mutex> guard(consumers_mutex_);
+
+        if (separation > 0)
+          throttled_consumers_.insert(separation);
+        else
+          unthrottled_consumers_++;
+
+        update_time_based_filter();
+      }
+
+      void remove_consumer(long long separation)
+      {
+        std::lock_guard<std::mutex> guard(consumers_mutex_);
+
+        if (separation > 0)
+          throttled_consumers_.erase(throttled_consumers_.find(separation));
+        else
+          unthrottled_consumers_--;
+
+        update_time_based_filter();
+      }
+
+      // TIME_BASED_FILTER is changeable, so the reader follows the 
+      // subscribers as they come and go. When the QoS can't express the
+      // separation (it may not exceed the DEADLINE period, or set_qos 
+      // fails) the filter is left off and the subscribers throttle on 
+      // their own side. Either way the outcome is remembered, so the
+      // same separation is not tried again until the subscribers change
+      // what they ask for. Called with consumers_mutex_ held.
+      void update_time_based_filter()
+      {
+        long long separation = 0;
+        if ((unthrottled_consumers_ == 0) && !throttled_consumers_.empty())
+          separation = *throttled_consumers_.begin();
+
+        if (separation == requested_separation_)
+          return;
+
+        requested_separation_ = separation;
+
+        try {
+          dds::sub::qos::DataReaderQos qos = reader_.qos();
+          dds::core::Duration minimum_separation = from_nanosecs(separation);
+
+          if (qos.policy<dds::core::policy::Deadline>().period() < minimum_separation)
+            minimum_separation = from_nanosecs(0);
+
+          long long applied = to_nanosecs(minimum_separation);
+          if (applied == applied_separation_.load(std::memory_order_relaxed))
+            return;
+
+          // Lift the throttles' reliance on the old filter before the 
+          // reader stops applying it, and only rely on a new one once
+          // the reader has accepted it.
+          if (applied < applied_separation_.load(std::memory_order_relaxed))
+            applied_separation_.store(applied, std::memory_order_relaxed);
+
+          qos << dds::core::policy::TimeBasedFilter(minimum_separation);
+          reader_.qos(qos);
+          applied_separation_.store(applied, std::memory_order_relaxed);
+        }
+        catch (const dds::core::Exception &)
+        {
+          // Application-side throttling still applies.
+        }
+      }
     };
 
   } // namespace detail
@@ -217,6 +766,31 @@ namespace rx4dds {
         { }
     };
 
+    namespace detail {
+
+      // One NotAliveNoWriters for all instances: when a writer goes away
+      // with many instances, building (and, on some platforms, throwing)
+      // an exception per instance dominated the burst. It is a static 
+      // member of a class template, so the header can define it and it is
+      // built during static initialization: VS2013 does not make the 
+      // initialization of function-local statics thread-safe.
+      template <class Dummy = void>
+      struct NotAliveNoWritersError
+      {
+        static const std::exception_ptr error;
+      };
+
+      template <class Dummy>
+      const std::exception_ptr NotAliveNoWritersError<Dummy>::error =
+        std::make_exception_ptr(NotAliveNoWriters("NotAliveNoWriters"));
+
+      inline std::exception_ptr not_alive_no_writers_error()
+      {
+        return NotAliveNoWritersError<>::error;
+      }
+
+    } // namespace detail
+
     template <class T>
     class TopicSubscription
     {
@@ -232,6 +806,8 @@ namespace rx4dds {
 
           typename rxcpp::subjects::subject<rti::sub::LoanedSample<T>>::subscriber_type subscriber =
             state_->data_subject_.get_subscriber();
+          typename rxcpp::subjects::subject<Sample<T>>::subscriber_type sample_subscriber =
+            state_->sample_subject_.get_subscriber();
 
           std::shared_ptr<detail::SubscriptionState<T>> state = state_;
 
@@ -239,25 +815,34 @@ namespace rx4dds {
             dds::sub::cond::ReadCondition(
             state_->reader_,
             dds::sub::status::DataState::any(),
-            [state, subscriber]()
+            [state, subscriber, sample_subscriber]()
           {
             try {
               dds::sub::LoanedSamples<T> samples =
                 state->reader_.take();
 
+              // Sample<T>s are decoded here, once per sample, and only
+              // if create_sample_observable() has subscribers.
+              bool decode = state->sample_subject_.has_observers();
+
               for (auto sample : samples)
               {
                 subscriber.on_next(sample);
+                if (decode)
+                  sample_subscriber.on_next(Sample<T>(sample));
               }
             }
             catch (...)
             {
               subscriber.on_error(std::current_exception());
+              sample_subscriber.on_error(std::current_exception());
               state->data_subject_ = rxcpp::subjects::subject<rti::sub::LoanedSample<T>>();
+              state->sample_subject_ = rxcpp::subjects::subject<Sample<T>>();
             }
           });
 
-          state_->wait_set_ += state_->read_condition_;
+          if (!state_->paused_)
+            state_->wait_set_ += state_->read_condition_;
           state_->init_read_condition_done_ = true;
         }
       }
@@ -281,6 +866,26 @@ namespace rx4dds {
         }
       }
 
+      rxcpp::observable<rti::sub::LoanedSample<T>> create_observable_with_separation(long long separation)
+      {
+        TopicSubscription<T> topic_sub = *this;
+
+        return rxcpp::observable<>::create<rti::sub::LoanedSample<T>>(
+          [topic_sub, separation](rxcpp::subscriber<rti::sub::LoanedSample<T>> subscriber)
+        {
+          detail::remove_const(topic_sub).initialize_read_condition();
+          std::shared_ptr<detail::SubscriptionState<T>> state = topic_sub.state_;
+          state->add_consumer(separation);
+
+          rxcpp::composite_subscription subscription =
+            state->data_subject_.get_observable().subscribe(subscriber);
+          subscription.add(rxcpp::make_subscription([state, separation]() {
+            state->remove_consumer(separation);
+          }));
+          return subscription;
+        });
+      }
+
     public:
       TopicSubscription(dds::domain::DomainParticipant part,
                         const std::string & topic_name,
@@ -291,15 +896,43 @@ namespace rx4dds {
       { }
 
       rxcpp::observable<rti::sub::LoanedSample<T>> create_observable()
+      {
+        return create_observable_with_separation(0);
+      }
+
+      // Same as create_observable() >> throttle, except that the 
+      // throttling is also pushed down to the DataReader's 
+      // TIME_BASED_FILTER QoS whenever every subscriber of this topic 
+      // is throttled, so the extra samples are dropped by the middleware.
+      rxcpp::observable<rti::sub::LoanedSample<T>> 
+        create_observable(const detail::ThrottlePerInstanceOp & throttle)
+      {
+        std::shared_ptr<const std::atomic<long long>> applied_separation(
+          state_, &state_->applied_separation_);
+
+        return create_observable_with_separation(detail::to_nanosecs(throttle.minimum_separation()))
+          .op(throttle.pushed_down_to(applied_separation));
+      }
+
+      // The samples as pre-decoded Sample<T>s, for pipelines of several
+      // operators that would otherwise each decode the SampleInfo. They
+      // are decoded right after take(), once for all their subscribers.
+      rxcpp::observable<Sample<T>> create_sample_observable()
       {
         TopicSubscription<T> topic_sub = *this;
 
-        return rxcpp::observable<>::create<rti::sub::LoanedSample<T>>(
-          [topic_sub](rxcpp::subscriber<rti::sub::LoanedSample<T>> subscriber)
+        return rxcpp::observable<>::create<Sample<T>>(
+          [topic_sub](rxcpp::subscriber<Sample<T>> subscriber)
         {
           detail::remove_const(topic_sub).initialize_read_condition();
+          std::shared_ptr<detail::SubscriptionState<T>> state = topic_sub.state_;
+          state->add_consumer(0);
+
           rxcpp::composite_subscription subscription =
-            topic_sub.state_->data_subject_.get_observable().subscribe(subscriber);
+            state->sample_subject_.get_observable().subscribe(subscriber);
+          subscription.add(rxcpp::make_subscription([state]() {
+            state->remove_consumer(0);
+          }));
           return subscription;
         });
       }
@@ -318,26 +951,196 @@ namespace rx4dds {
         });
       }
 
+      // Stops taking samples by detaching the ReadCondition from the 
+      // WaitSet. Meanwhile the samples wait in the DataReader, whose 
+      // HISTORY QoS keeps only the latest ones of each instance.
+      void pause()
+      {
+        if (state_->paused_)
+          return;
+
+        if (state_->init_read_condition_done_)
+          state_->wait_set_ -= state_->read_condition_;
+        state_->paused_ = true;
+      }
+
+      void resume()
+      {
+        if (!state_->paused_)
+          return;
+
+        if (state_->init_read_condition_done_)
+          state_->wait_set_ += state_->read_condition_;
+        state_->paused_ = false;
+      }
+
+      bool paused() const
+      {
+        return state_->paused_;
+      }
+
       void reset()
       {
         state_.reset();
       }
     };
 
-    template <class Key, class T, class KeySelector>
-    class KeyedTopicSubscription : public TopicSubscription<T>
+    // Watches a reliable DataWriter and tells whether it is congested: 
+    // from the time its unacknowledged samples reach high_watermark 
+    // until they are back down to low_watermark. Nothing is read until
+    // poll(), which the shedding operators call for every value. So 
+    // that the pressure is also read while no value flows, e.g., with 
+    // a paused TopicSubscription, the dispatch loop must call dispatch()
+    // below instead of WaitSet::dispatch(). The writer's StatusCondition
+    // is attached to the WaitSet, so that dispatch() returns when the 
+    // writer cache changes, and it has no handler: only the poll() that
+    // follows resets it. poll() and the observers it notifies run under
+    // one lock, which the shedding operators share, so pipelines on 
+    // different threads may share a WriterBackpressure.
+    template <class T>
+    class WriterBackpressure
     {
-      typedef rxcpp::grouped_observable<Key, rti::sub::LoanedSample<T>> GroupedObservable;
-
-      class Bucket
+      struct BackpressureState
       {
-        std::vector<rti::sub::LoanedSample<T>> snapshot_batch_;
-        rxcpp::subjects::subject<rti::sub::LoanedSample<T>> subject_;
-        rxcpp::composite_subscription subscription_;
+        dds::pub::DataWriter<T> writer_;
+        dds::core::cond::WaitSet wait_set_;
+        dds::core::cond::StatusCondition status_condition_;
+        long long high_watermark_;
+        long long low_watermark_;
+        std::recursive_mutex lock_;
+        WriterPressure pressure_;
+        rxcpp::subjects::subject<WriterPressure> subject_;
+
+        BackpressureState(dds::pub::DataWriter<T> writer,
+                          dds::core::cond::WaitSet wait_set,
+                          long long high_watermark,
+                          long long low_watermark)
+          : writer_(writer),
+            wait_set_(wait_set),
+            status_condition_(writer),
+            high_watermark_(high_watermark),
+            low_watermark_(low_watermark)
+        {
+          WriterPressure none = { 0, 0, false };
+          pressure_ = none;
 
-      public:
+          status_condition_.enabled_statuses(
+            rti::core::status::StatusMask::reliable_writer_cache_changed());
+          wait_set_ += status_condition_;
+        }
 
-        Bucket() {}
+        ~BackpressureState()
+        {
+          wait_set_ -= status_condition_;
+        }
+      };
+
+      std::shared_ptr<BackpressureState> state_;
+
+    public:
+
+      WriterBackpressure(dds::pub::DataWriter<T> writer,
+                         dds::core::cond::WaitSet wait_set,
+                         long long high_watermark,
+                         long long low_watermark)
+      {
+        if ((low_watermark < 0) || (low_watermark > high_watermark))
+          throw std::invalid_argument("WriterBackpressure: need 0 <= low_watermark <= high_watermark");
+
+        state_ = std::make_shared<BackpressureState>(
+          writer, wait_set, high_watermark, low_watermark);
+      }
+
+      // Reads the writer statuses and returns whether the writer is 
+      // congested. Observers hear of every change.
+      bool poll()
+      {
+        BackpressureState & state = *state_;
+        std::lock_guard<std::recursive_mutex> guard(state.lock_);
+
+        // Reading the status also resets the StatusCondition.
+        state.pressure_.unacknowledged_samples =
+          state.writer_->reliable_writer_cache_changed_status().unacknowledged_sample_count();
+        state.pressure_.cache_samples =
+          state.writer_->datawriter_cache_status().sample_count();
+
+        bool congested = state.pressure_.congested
+          ? (state.pressure_.unacknowledged_samples > state.low_watermark_)
+          : (state.pressure_.unacknowledged_samples >= state.high_watermark_);
+
+        if (congested != state.pressure_.congested)
+        {
+          state.pressure_.congested = congested;
+          state.subject_.get_subscriber().on_next(state.pressure_);
+        }
+
+        return congested;
+      }
+
+      // Dispatches the WaitSet once and then polls the writer. Use it 
+      // in place of WaitSet::dispatch() in the dispatch loop.
+      void dispatch(const dds::core::Duration & timeout)
+      {
+        state_->wait_set_.dispatch(timeout);
+        poll();
+      }
+
+      // Runs func under the lock poll() holds while it notifies the 
+      // observers, e.g., the buffers of the shedding operators.
+      template <class Func>
+      auto synchronize(Func func) const -> decltype(func())
+      {
+        std::lock_guard<std::recursive_mutex> guard(state_->lock_);
+        return func();
+      }
+
+      bool congested() const
+      {
+        std::lock_guard<std::recursive_mutex> guard(state_->lock_);
+        return state_->pressure_.congested;
+      }
+
+      WriterPressure pressure() const
+      {
+        std::lock_guard<std::recursive_mutex> guard(state_->lock_);
+        return state_->pressure_;
+      }
+
+      // Emits when the writer becomes congested and when it recovers.
+      rxcpp::observable<WriterPressure> create_observable() const
+      {
+        return state_->subject_.get_observable();
+      }
+    };
+
+    // Pauses topic_sub while pressure says that the writer is congested.
+    template <class T, class W>
+    rxcpp::composite_subscription pause_on_backpressure(TopicSubscription<T> topic_sub,
+                                                        WriterBackpressure<W> pressure)
+    {
+      return pressure.create_observable().subscribe(
+        [topic_sub](const WriterPressure & writer_pressure) {
+          if (writer_pressure.congested)
+            detail::remove_const(topic_sub).pause();
+          else
+            detail::remove_const(topic_sub).resume();
+      });
+    }
+
+    template <class Key, class T, class KeySelector>
+    class KeyedTopicSubscription : public TopicSubscription<T>
+    {
+      typedef rxcpp::grouped_observable<Key, rti::sub::LoanedSample<T>> GroupedObservable;
+
+      class Bucket
+      {
+        std::vector<rti::sub::LoanedSample<T>> snapshot_batch_;
+        rxcpp::subjects::subject<rti::sub::LoanedSample<T>> subject_;
+        rxcpp::composite_subscription subscription_;
+
+      public:
+
+        Bucket() {}
 
         Bucket(Key key,
                rxcpp::subjects::subject<GroupedObservable> shared_topsubject)
@@ -542,30 +1345,48 @@ namespace rx4dds {
         return t;
       }
 
+      // Groups a LoanedSample<T> or a Sample<T> stream by instance. The
+      // grouped streams carry the same kind of sample as the input.
       template <class Key, class T, class KeySelector>
       class GroupByDDSInstanceOp
       {
-        typedef rxcpp::grouped_observable<Key, rti::sub::LoanedSample<T>> GroupedObservable;
+        // What the instance events report about an instance. It lives 
+        // in the instance's bucket, so nothing is kept once the instance
+        // is disposed: a rebirth is told by the reader's generation count.
+        struct InstanceRecord
+        {
+          Key key;
+          unsigned long long generation;
+          bool no_writers;
+        };
 
+        template <class Element>
         class Bucket
         {
-          rxcpp::subjects::subject<rti::sub::LoanedSample<T>> subject_;
+          typedef rxcpp::grouped_observable<Key, Element> GroupedObservable;
+
+          rxcpp::subjects::subject<Element> subject_;
           rxcpp::composite_subscription subscription_;
+          InstanceRecord record_;
 
         public:
 
-          Bucket() {}
+          Bucket() : record_() {}
 
           Bucket(Key key,
+                 unsigned long long generation,
                  rxcpp::subjects::subject<GroupedObservable> shared_topsubject)
           {
+            InstanceRecord record = { key, generation, false };
+            record_ = record;
+
             subscription_ =
               subject_
               .get_observable()
-              .group_by([key](rti::sub::LoanedSample<T> sample) {
+              .group_by([key](Element sample) {
                   return key;
               },
-              [](rti::sub::LoanedSample<T> sample) { 
+              [](Element sample) { 
                   return sample; 
               })
               .map([shared_topsubject](GroupedObservable go) {
@@ -575,23 +1396,47 @@ namespace rx4dds {
               .subscribe();
           }
 
-          rxcpp::subjects::subject<rti::sub::LoanedSample<T>> & get_subject()
+          rxcpp::subjects::subject<Element> & get_subject()
           {
             return subject_;
           }
-        };
 
-        typedef std::unordered_map<dds::core::InstanceHandle, Bucket> BucketMap;
+          InstanceRecord & record()
+          {
+            return record_;
+          }
+        };
 
+        // Shared by every stream the operator is applied to.
         struct GroupByState
         {
           KeySelector key_selector_;
-          BucketMap buckets_;
-          rxcpp::subjects::subject<GroupedObservable> shared_topsubject_;
+          rxcpp::subjects::subject<InstanceEvent<Key>> events_subject_;
 
           explicit GroupByState(KeySelector&& key_selector)
             : key_selector_(std::move(key_selector))
           {}
+
+          void emit(InstanceEventKind kind,
+                    const dds::core::InstanceHandle & handle,
+                    const InstanceRecord & record)
+          {
+            if (events_subject_.has_observers())
+            {
+              InstanceEvent<Key> event = { kind, record.key, handle, record.generation };
+              events_subject_.get_subscriber().on_next(event);
+            }
+          }
+        };
+
+        // The buckets of the stream the operator is applied to.
+        template <class Element>
+        struct BucketState
+        {
+          typedef std::unordered_map<dds::core::InstanceHandle, Bucket<Element>> BucketMap;
+
+          BucketMap buckets_;
+          rxcpp::subjects::subject<rxcpp::grouped_observable<Key, Element>> shared_topsubject_;
         };
 
         std::shared_ptr<GroupByState> state_;
@@ -602,36 +1447,50 @@ namespace rx4dds {
           : state_(std::make_shared<GroupByState>(std::move(key_selector)))
         { }
 
-        rxcpp::observable<GroupedObservable>
-          operator()(const rxcpp::observable<rti::sub::LoanedSample<T>> & prev) const
+        // Lifecycle of the instances seen by this operator. Subscribe 
+        // before the grouped stream to see every event.
+        rxcpp::observable<InstanceEvent<Key>> instance_events() const
+        {
+          return state_->events_subject_.get_observable();
+        }
+
+        template <class Element>
+        rxcpp::observable<rxcpp::grouped_observable<Key, Element>>
+          operator()(const rxcpp::observable<Element> & prev) const
         {
+          typedef rxcpp::grouped_observable<Key, Element> GroupedObservable;
+          typedef typename BucketState<Element>::BucketMap BucketMap;
+
           std::shared_ptr<GroupByState> groupby_state = state_;
+          auto bucket_state = std::make_shared<BucketState<Element>>();
 
           return rxcpp::observable<>::create<GroupedObservable>(
-            [groupby_state, prev](rxcpp::subscriber<GroupedObservable> subscriber)
+            [groupby_state, bucket_state, prev](rxcpp::subscriber<GroupedObservable> subscriber)
           {
             rxcpp::composite_subscription subscription;
-            subscription.add(groupby_state->shared_topsubject_.get_observable().subscribe(subscriber));
+            subscription.add(bucket_state->shared_topsubject_.get_observable().subscribe(subscriber));
 
             subscription.add(prev.subscribe(
-              [groupby_state, subscription](rti::sub::LoanedSample<T> sample)
+              [groupby_state, bucket_state, subscription](const Element & sample)
             {
               try {
-                dds::sub::status::InstanceState istate;
-                sample.info().state() >> istate;
-                dds::core::InstanceHandle handle = sample.info().instance_handle();
-                BucketMap::const_iterator got = groupby_state->buckets_.find(handle);
+                BucketMap & buckets = bucket_state->buckets_;
+                unsigned char flags = sample_flags(sample);
+                dds::core::InstanceHandle handle = sample_instance_handle(sample);
+                typename BucketMap::iterator got = buckets.find(handle);
 
-                if (istate == dds::sub::status::InstanceState::not_alive_disposed())
+                if (flags & SAMPLE_DISPOSED)
                 {
-                  if (got != groupby_state->buckets_.end()) // instance exists
+                  if (got != buckets.end()) // instance exists
                   {
-                    groupby_state->buckets_[handle]
+                    got->second
                       .get_subject()
                       .get_subscriber()
                       .on_completed();
 
-                    groupby_state->buckets_.erase(handle);
+                    InstanceRecord record = got->second.record();
+                    buckets.erase(got);
+                    groupby_state->emit(InstanceEventKind::DISPOSED, handle, record);
                   }
                   else
                   {
@@ -640,22 +1499,41 @@ namespace rx4dds {
                 }
                 else
                 {
-                  if (sample.info().valid() && (got == groupby_state->buckets_.end())) // new instance
+                  if ((flags & SAMPLE_VALID) && (got == buckets.end())) // new instance
                   {
-                    groupby_state->buckets_.emplace(
+                    Key key = groupby_state->key_selector_(sample.data());
+                    unsigned long long generation = sample_disposed_generation(sample);
+                    got = buckets.emplace(
                       std::make_pair(handle, 
-                                     Bucket(groupby_state->key_selector_(sample.data()),
-                                            groupby_state->shared_topsubject_)));
+                                     Bucket<Element>(key, generation, bucket_state->shared_topsubject_))).first;
+
+                    groupby_state->emit((generation == 0) ? InstanceEventKind::NEW : InstanceEventKind::REBORN,
+                                        handle,
+                                        got->second.record());
+                  }
+                  else if (got != buckets.end())
+                  {
+                    InstanceRecord & record = got->second.record();
+                    bool no_writers = (flags & SAMPLE_NO_WRITERS) != 0;
+
+                    if (no_writers != record.no_writers)
+                    {
+                      record.no_writers = no_writers;
+                      groupby_state->emit(no_writers ? InstanceEventKind::NO_WRITERS : InstanceEventKind::ALIVE,
+                                          handle,
+                                          record);
+                    }
                   }
 
                   // A new grouped_observable is pushed through 
                   // topsubject before sample.
-                  groupby_state->buckets_[handle].get_subject().get_subscriber().on_next(sample);
+                  if (got != buckets.end())
+                    got->second.get_subject().get_subscriber().on_next(sample);
                 }
               }
               catch (...)
               {
-                groupby_state->shared_topsubject_.get_subscriber().on_error(std::current_exception());
+                bucket_state->shared_topsubject_.get_subscriber().on_error(std::current_exception());
                 subscription.unsubscribe();
               }
 
@@ -668,10 +1546,11 @@ namespace rx4dds {
 
       class InstanceStateInterpreter
       {
-        dds::sub::status::InstanceState interpreted_instance_state_;
+        unsigned char interpreted_flag_;
 
         explicit InstanceStateInterpreter(dds::sub::status::InstanceState state)
-          : interpreted_instance_state_(state)
+          : interpreted_flag_(
+              (state == dds::sub::status::InstanceState::not_alive_disposed()) ? SAMPLE_DISPOSED : SAMPLE_NO_WRITERS)
         {
           if ((state != dds::sub::status::InstanceState::not_alive_disposed()) &&
             (state != dds::sub::status::InstanceState::not_alive_no_writers()))
@@ -694,33 +1573,28 @@ namespace rx4dds {
         Observable operator()(Observable prev) const
         {
           typedef typename Observable::value_type LoanedSample;
-          dds::sub::status::InstanceState match_istate =
-            interpreted_instance_state_;
+          unsigned char match_flag = interpreted_flag_;
 
           return rxcpp::observable<>::create<LoanedSample>(
-            [prev, match_istate](rxcpp::subscriber<LoanedSample> subscriber)
+            [prev, match_flag](rxcpp::subscriber<LoanedSample> subscriber)
           {
             rxcpp::composite_subscription subscription;
             subscription.add(rxcpp::composite_subscription::empty());
 
             subscription.add(
               prev.subscribe(
-              [subscriber, subscription, match_istate](LoanedSample sample)
+              [subscriber, subscription, match_flag](const LoanedSample & sample)
             {
-              dds::sub::status::InstanceState istate;
-              sample.info().state() >> istate;
-
-              if (istate == match_istate)
+              if (sample_flags(sample) & match_flag)
               {
-                if (istate == dds::sub::status::InstanceState::not_alive_disposed())
+                if (match_flag == SAMPLE_DISPOSED)
                 {
                   subscriber.on_completed();
                   subscription.unsubscribe();
                 }
-                else if (istate == dds::sub::status::InstanceState::not_alive_no_writers())
+                else
                 {
-                  subscriber.on_error(
-                    std::make_exception_ptr(NotAliveNoWriters("NotAliveNoWriters")));
+                  subscriber.on_error(not_alive_no_writers_error());
                   subscription.unsubscribe();
                 }
               }
@@ -744,8 +1618,8 @@ namespace rx4dds {
         Observable operator ()(Observable prev) const
         {
           typedef typename Observable::value_type LoanedSample;
-          return prev.filter([](LoanedSample sample) {
-            return sample.info().valid();
+          return prev.filter([](const LoanedSample & sample) {
+            return sample_valid(sample);
           });
         }
       };
@@ -759,12 +1633,183 @@ namespace rx4dds {
           operator ()(Observable prev) const
         {
           typedef typename Observable::value_type LoanedSample;
-          return prev.map([](LoanedSample sample) {
+          return prev.map([](const LoanedSample & sample) {
             return sample.data();
           });
         }
       };
 
+      // complete_on_dispose() >> error_on_no_alive_writers() >> 
+      // skip_invalid_samples() >> map_samples_to_data() in one stage: 
+      // one subscription and one decoding of the instance state per 
+      // sample. Each step can be turned off at compile time.
+      template <bool CompleteOnDispose, bool ErrorOnNoWriters, bool SkipInvalid, bool MapToData>
+      class InstanceLifecycleOp
+      {
+        template <class LoanedSample>
+        static const LoanedSample & project(const LoanedSample & sample, std::false_type)
+        {
+          return sample;
+        }
+
+        template <class LoanedSample>
+        static const typename LoanedSample::DataType & project(const LoanedSample & sample, std::true_type)
+        {
+          return sample.data();
+        }
+
+      public:
+
+        template <class Observable>
+        rxcpp::observable<typename std::conditional<MapToData,
+                                                    typename Observable::value_type::DataType,
+                                                    typename Observable::value_type>::type>
+          operator ()(Observable prev) const
+        {
+          typedef typename Observable::value_type LoanedSample;
+          typedef typename std::conditional<MapToData,
+                                            typename LoanedSample::DataType,
+                                            LoanedSample>::type Result;
+
+          return rxcpp::observable<>::create<Result>(
+            [prev](rxcpp::subscriber<Result> subscriber)
+          {
+            rxcpp::composite_subscription subscription;
+            subscription.add(rxcpp::composite_subscription::empty());
+
+            subscription.add(
+              prev.subscribe(
+              [subscriber, subscription](const LoanedSample & sample)
+            {
+              unsigned char flags = sample_flags(sample);
+
+              if (CompleteOnDispose && (flags & SAMPLE_DISPOSED))
+              {
+                subscriber.on_completed();
+                subscription.unsubscribe();
+                return;
+              }
+
+              if (ErrorOnNoWriters && (flags & SAMPLE_NO_WRITERS))
+              {
+                subscriber.on_error(not_alive_no_writers_error());
+                subscription.unsubscribe();
+                return;
+              }
+
+              if (SkipInvalid && !(flags & SAMPLE_VALID))
+                return;
+
+              subscriber.on_next(project(sample, std::integral_constant<bool, MapToData>()));
+            },
+              [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr);  },
+              [subscriber]() { subscriber.on_completed();  }
+            ));
+
+            return subscription;
+          });
+        }
+      };
+
+      // Like InstanceLifecycleOp, but dispose and loss of writers are 
+      // delivered as a LifecycleEvent followed by on_completed, so 
+      // nothing downstream allocates or rethrows an exception to tell 
+      // them apart. Invalid samples that don't end the instance are skipped.
+      template <bool MapToData>
+      class LifecycleEventsOp
+      {
+        template <class LoanedSample>
+        static const LoanedSample & project(const LoanedSample & sample, std::false_type)
+        {
+          return sample;
+        }
+
+        template <class LoanedSample>
+        static const typename LoanedSample::DataType & project(const LoanedSample & sample, std::true_type)
+        {
+          return sample.data();
+        }
+
+      public:
+
+        template <class Observable>
+        rxcpp::observable<LifecycleEvent<typename std::conditional<MapToData,
+                                                                   typename Observable::value_type::DataType,
+                                                                   typename Observable::value_type>::type>>
+          operator ()(Observable prev) const
+        {
+          typedef typename Observable::value_type LoanedSample;
+          typedef LifecycleEvent<typename std::conditional<MapToData,
+                                                           typename LoanedSample::DataType,
+                                                           LoanedSample>::type> Result;
+
+          return rxcpp::observable<>::create<Result>(
+            [prev](rxcpp::subscriber<Result> subscriber)
+          {
+            rxcpp::composite_subscription subscription;
+            subscription.add(rxcpp::composite_subscription::empty());
+
+            subscription.add(
+              prev.subscribe(
+              [subscriber, subscription](const LoanedSample & sample)
+            {
+              unsigned char flags = sample_flags(sample);
+
+              if (flags & (SAMPLE_DISPOSED | SAMPLE_NO_WRITERS))
+              {
+                LifecycleKind kind =
+                  (flags & SAMPLE_DISPOSED) ? LifecycleKind::DISPOSED : LifecycleKind::NO_WRITERS;
+
+                subscriber.on_next(Result::end(kind));
+                subscriber.on_completed();
+                subscription.unsubscribe();
+                return;
+              }
+
+              if (flags & SAMPLE_VALID)
+                subscriber.on_next(Result(project(sample, std::integral_constant<bool, MapToData>())));
+            },
+              [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr);  },
+              [subscriber]() { subscriber.on_completed();  }
+            ));
+
+            return subscription;
+          });
+        }
+      };
+
+      // Same as MapSampleToDataOp without the copy: downstream gets a
+      // reference to the loaned data, which is only valid during on_next.
+      class MapSampleToDataRefOp
+      {
+      public:
+
+        template <class Observable>
+        rxcpp::observable<std::reference_wrapper<const typename Observable::value_type::DataType>>
+          operator ()(Observable prev) const
+        {
+          typedef typename Observable::value_type LoanedSample;
+          return prev.map([](const LoanedSample & sample) {
+            return std::cref(sample.data());
+          });
+        }
+      };
+
+      class ToSamplesOp
+      {
+      public:
+
+        template <class Observable>
+        rxcpp::observable<Sample<typename Observable::value_type::DataType>>
+          operator ()(Observable prev) const
+        {
+          typedef typename Observable::value_type LoanedSample;
+          return prev.map([](const LoanedSample & sample) {
+            return Sample<typename LoanedSample::DataType>(sample);
+          });
+        }
+      };
+
       class UnkeyOp
       {
       public:
@@ -779,6 +1824,18 @@ namespace rx4dds {
         }
       };
 
+#if defined(_MSC_VER) && (_MSC_VER < 1900)
+      // No noexcept operator before VS2015: every callable may throw.
+      template <class F, class Arg>
+      struct is_nothrow_callable : std::false_type
+      { };
+#else
+      template <class F, class Arg>
+      struct is_nothrow_callable
+        : std::integral_constant<bool, noexcept(std::declval<F &>()(std::declval<Arg>()))>
+      { };
+#endif
+
       template <class OnNext, class OnError, class OnCompleted>
       class DoOp // Same as tap
       {
@@ -786,18 +1843,52 @@ namespace rx4dds {
         OnError on_error_;
         OnCompleted on_completed_;
 
-      public:
+        // A noexcept on_next can't fail mid-stream, so there is no
+        // exception frame per sample and no subscription of our own 
+        // to cancel: the tap runs on the downstream subscription.
+        template <class T>
+        rxcpp::observable<T> apply(rxcpp::observable<T> prev, std::true_type) const
+        {
+          OnNext on_next = on_next_;
+          OnError on_error = on_error_;
+          OnCompleted on_completed = on_completed_;
 
-        DoOp(OnNext on_next,
-          OnError on_error,
-          OnCompleted on_completed)
-          : on_next_(std::move(on_next)),
-            on_error_(std::move(on_error)),
-            on_completed_(std::move(on_completed))
-        { }
+          return rxcpp::observable<>::create<T>(
+            [prev, on_next, on_error, on_completed](rxcpp::subscriber<T> subscriber)
+          {
+            return prev.subscribe(
+              subscriber.get_subscription(),
+              [subscriber, on_next](T & t)
+            {
+              on_next(t);
+              subscriber.on_next(t);
+            },
+              [subscriber, on_error](std::exception_ptr eptr)
+            {
+              try {
+                on_error(eptr);
+                subscriber.on_error(eptr);
+              }
+              catch (...)
+              {
+                subscriber.on_error(std::current_exception());
+              }
+            },
+              [subscriber, on_completed]() {
+              try {
+                on_completed();
+                subscriber.on_completed();
+              }
+              catch (...)
+              {
+                subscriber.on_error(std::current_exception());
+              }
+            });
+          });
+        }
 
         template <class T>
-        rxcpp::observable<T> operator ()(rxcpp::observable<T> prev) const
+        rxcpp::observable<T> apply(rxcpp::observable<T> prev, std::false_type) const
         {
           OnNext on_next = on_next_;
           OnError on_error = on_error_;
@@ -849,6 +1940,22 @@ namespace rx4dds {
             return subscription;
           });
         }
+
+      public:
+
+        DoOp(OnNext on_next,
+          OnError on_error,
+          OnCompleted on_completed)
+          : on_next_(std::move(on_next)),
+            on_error_(std::move(on_error)),
+            on_completed_(std::move(on_completed))
+        { }
+
+        template <class T>
+        rxcpp::observable<T> operator ()(rxcpp::observable<T> prev) const
+        {
+          return apply(prev, is_nothrow_callable<typename std::decay<OnNext>::type, T &>());
+        }
       };
 
     } // namespace detail
@@ -862,143 +1969,2860 @@ namespace rx4dds {
     class PublishOverDDSOp
     {
       dds::pub::DataWriter<T> data_writer_;
-      T dispose_instance_;
+      std::shared_ptr<const T> dispose_instance_;
     public:
 
       PublishOverDDSOp(dds::pub::DataWriter<T> datawriter,
         const T & instance)
         : data_writer_(datawriter),
-          dispose_instance_(instance)
+          dispose_instance_(std::make_shared<const T>(instance))
       { }
 
       rxcpp::observable<T> operator ()(rxcpp::observable<T> prev) const
       {
         dds::pub::DataWriter<T> data_writer = data_writer_;
-        const T & instance = dispose_instance_;
+        std::shared_ptr<const T> instance = dispose_instance_;
 
         return prev.tap(
-          [data_writer](T & t) {
+          [data_writer](const T & t) {
             remove_const(data_writer).write(t);
           },
           [data_writer, instance](std::exception_ptr eptr) { 
-            dds::pub::DataWriter<T> & dw = remove_const(data_writer);
-            dw.dispose_instance(dw.register_instance(instance));
+            dispose(remove_const(data_writer), *instance);
           },
           [data_writer, instance]() {
-            dds::pub::DataWriter<T> & dw = remove_const(data_writer);
-            dw.dispose_instance(dw.register_instance(instance));
+            dispose(remove_const(data_writer), *instance);
         });
       }
+
+      // The instance has normally been written already, so look it up 
+      // rather than registering it again.
+      static void dispose(dds::pub::DataWriter<T> & dw, const T & instance)
+      {
+        dds::core::InstanceHandle handle = dw.lookup_instance(instance);
+        if (handle.is_nil())
+          handle = dw.register_instance(instance);
+
+        dw.dispose_instance(handle);
+      }
     };
 
-    class CoalesceAliveOp
+    template <class T, class Fill, class U>
+    void write_in_place(dds::pub::DataWriter<T> & dw, 
+                        Fill & fill, 
+                        T * buffer, 
+                        const U & u, 
+                        std::false_type /* loan */)
     {
-    public:
+      fill(u, *buffer);
+      dw.write(*buffer);
+    }
+
+#if RX4DDS_HAVE_WRITER_LOAN
+    template <class T, class Fill, class U>
+    void write_in_place(dds::pub::DataWriter<T> & dw, 
+                        Fill & fill, 
+                        T *, 
+                        const U & u, 
+                        std::true_type /* loan */)
+    {
+      // A sample stays on loan unless write() succeeds.
+      T * sample = dw.extensions().get_loan();
+      try {
+        fill(u, *sample);
+        dw.write(*sample);
+      }
+      catch (...)
+      {
+        dw.extensions().discard_loan(*sample);
+        throw;
+      }
+    }
+#endif
+
+    // Builds each sample with fill(u, sample) right where it is 
+    // written from, instead of in a T handed down the pipeline. With 
+    // UseLoan the sample is a DataWriter loan; otherwise it is one T 
+    // reused for every value of a subscription, so fill must assign 
+    // every field. Emits the values of prev.
+    template <class T, class Fill, bool UseLoan>
+    class PublishInPlaceOverDDSOp
+    {
+      static_assert(!UseLoan || RX4DDS_HAVE_WRITER_LOAN,
+                    "DataWriter loans need Connext 6.0 or later");
+
+      dds::pub::DataWriter<T> data_writer_;
+      std::shared_ptr<const T> dispose_instance_;
+      Fill fill_;
+
+    public:
+
+      PublishInPlaceOverDDSOp(dds::pub::DataWriter<T> datawriter,
+                              const T & instance,
+                              Fill fill)
+        : data_writer_(datawriter),
+          dispose_instance_(std::make_shared<const T>(instance)),
+          fill_(fill)
+      { }
 
       template <class Observable>
-      static void remove_observable(
-        std::vector<Observable> & observable_vec,
-        std::vector<rxcpp::subscription> & subscription_vec,
-        Observable observable)
+      rxcpp::observable<typename Observable::value_type> 
+        operator ()(Observable prev) const
       {
-        auto iter = std::find(observable_vec.begin(), observable_vec.end(), observable);
-        if (iter != observable_vec.end())
+        typedef typename Observable::value_type U;
+
+        dds::pub::DataWriter<T> data_writer = data_writer_;
+        std::shared_ptr<const T> instance = dispose_instance_;
+        Fill fill = fill_;
+
+        return rxcpp::observable<>::create<U>(
+          [prev, data_writer, instance, fill](rxcpp::subscriber<U> subscriber)
         {
-          size_t index = iter - observable_vec.begin();
-          observable_vec.erase(iter);
-          subscription_vec.erase(subscription_vec.begin() + index);
-        }
+          std::shared_ptr<T> buffer;
+          if (!UseLoan)
+            buffer = std::make_shared<T>();
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [data_writer, fill, buffer, subscriber, subscription](const U & u)
+          {
+            try {
+              write_in_place(remove_const(data_writer), 
+                             remove_const(fill), 
+                             buffer.get(), 
+                             u, 
+                             std::integral_constant<bool, UseLoan>());
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+              return;
+            }
+            subscriber.on_next(u);
+          },
+            [data_writer, instance, subscriber](std::exception_ptr eptr)
+          {
+            try {
+              PublishOverDDSOp<T>::dispose(remove_const(data_writer), *instance);
+            }
+            catch (...)
+            {
+              // eptr is the error to report.
+            }
+            subscriber.on_error(eptr);
+          },
+            [data_writer, instance, subscriber]()
+          {
+            try {
+              PublishOverDDSOp<T>::dispose(remove_const(data_writer), *instance);
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              return;
+            }
+            subscriber.on_completed();
+          }));
+
+          return subscription;
+        });
       }
+    };
 
-      template <class ObservableOfObservable>
-      rxcpp::observable<std::vector<typename ObservableOfObservable::value_type>>
-        operator ()(ObservableOfObservable prev) const
+    // Registers each instance the first time its key shows up and 
+    // remembers the handle, so that write(t, handle) need not hash the
+    // key fields of every sample.
+    template <class T, class Key>
+    class InstanceHandleCache
+    {
+      typedef std::unordered_map<Key, dds::core::InstanceHandle> HandleMap;
+      HandleMap handles_;
+
+    public:
+
+      dds::core::InstanceHandle handle(dds::pub::DataWriter<T> & dw, 
+                                       const Key & key,
+                                       const T & t)
       {
-        typedef std::vector<typename ObservableOfObservable::value_type> ResultType;
-        typedef std::vector<rxcpp::subscription> SubscriptionVecType;
-          
-        auto alive_vec_ptr = std::make_shared<ResultType> ();
-        auto alive_sub_ptr = std::make_shared<SubscriptionVecType>();
-        auto lock = std::make_shared<std::mutex>();
+        typename HandleMap::iterator iter = handles_.find(key);
+        if (iter == handles_.end())
+          iter = handles_.insert(std::make_pair(key, dw.register_instance(t))).first;
 
-        return rxcpp::observable<>::create<ResultType>(
-          [alive_vec_ptr, alive_sub_ptr, prev, lock](rxcpp::subscriber<ResultType> subscriber)
+        return iter->second;
+      }
+
+      // Returns the nil handle if the key has never been seen.
+      dds::core::InstanceHandle find(const Key & key) const
+      {
+        typename HandleMap::const_iterator iter = handles_.find(key);
+        return (iter == handles_.end()) ? dds::core::InstanceHandle::nil() : iter->second;
+      }
+
+      // Forgets the instance and returns its handle (nil if unknown).
+      dds::core::InstanceHandle erase(const Key & key)
+      {
+        typename HandleMap::iterator iter = handles_.find(key);
+        if (iter == handles_.end())
+          return dds::core::InstanceHandle::nil();
+
+        dds::core::InstanceHandle handle = iter->second;
+        handles_.erase(iter);
+        return handle;
+      }
+
+      size_t size() const
+      {
+        return handles_.size();
+      }
+
+      // Calls func(handle) for every instance and forgets them all.
+      template <class Func>
+      void drain(Func func)
+      {
+        HandleMap handles;
+        handles.swap(handles_);
+        for (const typename HandleMap::value_type & entry : handles)
+          func(entry.second);
+      }
+    };
+
+    template <class T, class KeySelector>
+    class KeyedPublishOverDDSOp
+    {
+      typedef typename std::decay<
+        typename std::result_of<KeySelector(const T &)>::type>::type Key;
+
+      dds::pub::DataWriter<T> data_writer_;
+      std::shared_ptr<const T> dispose_instance_;
+      KeySelector key_selector_;
+
+    public:
+
+      KeyedPublishOverDDSOp(dds::pub::DataWriter<T> datawriter,
+                            const T & instance,
+                            KeySelector key_selector)
+        : data_writer_(datawriter),
+          dispose_instance_(std::make_shared<const T>(instance)),
+          key_selector_(key_selector)
+      { }
+
+      rxcpp::observable<T> operator ()(rxcpp::observable<T> prev) const
+      {
+        dds::pub::DataWriter<T> data_writer = data_writer_;
+        std::shared_ptr<const T> instance = dispose_instance_;
+        KeySelector key_selector = key_selector_;
+
+        return rxcpp::observable<>::create<T>(
+          [prev, data_writer, instance, key_selector](rxcpp::subscriber<T> subscriber)
+        {
+          // One cache per subscription: the pipeline calls it from one 
+          // thread at a time.
+          auto cache = std::make_shared<InstanceHandleCache<T, Key>>();
+
+          auto dispose = [data_writer, instance, key_selector, cache]() {
+            dds::pub::DataWriter<T> & dw = remove_const(data_writer);
+            const Key & key = remove_const(key_selector)(*instance);
+            dw.dispose_instance(cache->handle(dw, key, *instance));
+          };
+
+          prev.tap(
+            [data_writer, key_selector, cache](const T & t) {
+              dds::pub::DataWriter<T> & dw = remove_const(data_writer);
+              const Key & key = remove_const(key_selector)(t);
+              dw.write(t, cache->handle(dw, key, t));
+            },
+            [dispose](std::exception_ptr) {
+              dispose();
+            },
+            [dispose]() {
+              dispose();
+            })
+          .subscribe(subscriber);
+        });
+      }
+    };
+
+    // The key and the values of a grouped stream. Besides the output of
+    // group_by_dds_instance(), a pair of a key and an observable will do.
+    template <class Key, class T, class SourceOperator>
+    Key grouped_key(const rxcpp::grouped_observable<Key, T, SourceOperator> & go)
+    {
+      return go.get_key();
+    }
+
+    template <class Key, class T, class SourceOperator>
+    const rxcpp::grouped_observable<Key, T, SourceOperator> & 
+      grouped_values(const rxcpp::grouped_observable<Key, T, SourceOperator> & go)
+    {
+      return go;
+    }
+
+    template <class Key, class Observable>
+    Key grouped_key(const std::pair<Key, Observable> & group)
+    {
+      return group.first;
+    }
+
+    template <class Key, class Observable>
+    const Observable & grouped_values(const std::pair<Key, Observable> & group)
+    {
+      return group.second;
+    }
+
+    // Writes the values of every grouped stream through one 
+    // DataWriter. All instances share one table of handles, registered
+    // with the first value of each group and disposed (or unregistered)
+    // when the group ends. The values of a group must all belong to the
+    // instance the group key names.
+    template <class T>
+    class PublishGroupedOverDDSOp
+    {
+      dds::pub::DataWriter<T> data_writer_;
+      InstanceEndPolicy end_policy_;
+
+    public:
+
+      PublishGroupedOverDDSOp(dds::pub::DataWriter<T> datawriter,
+                              InstanceEndPolicy end_policy)
+        : data_writer_(datawriter),
+          end_policy_(end_policy)
+      { }
+
+      template <class Observable>
+      rxcpp::observable<T> operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type Group;
+        typedef typename std::decay<
+          decltype(grouped_key(std::declval<Group>()))>::type Key;
+
+        struct WriterState
+        {
+          dds::pub::DataWriter<T> writer;
+          InstanceEndPolicy end_policy;
+          InstanceHandleCache<T, Key> handles;
+          size_t active_groups;
+          bool source_completed;
+
+          WriterState(dds::pub::DataWriter<T> dw, InstanceEndPolicy policy)
+            : writer(dw),
+              end_policy(policy),
+              active_groups(0),
+              source_completed(false)
+          { }
+
+          void end_instance(const dds::core::InstanceHandle & handle)
           {
-            return prev.subscribe(
-              [alive_vec_ptr, alive_sub_ptr, subscriber, lock]
-              (typename ObservableOfObservable::value_type next_observable) {
-                std::unique_lock<std::mutex> guard(*lock);
-                auto & alive_vector = *detail::remove_const(alive_vec_ptr);
-                auto iter = std::find(alive_vector.begin(), alive_vector.end(), next_observable);
-                if (iter == alive_vector.end())
-                {
-                  alive_vector.push_back(next_observable);
-                  detail::remove_const(alive_sub_ptr)->push_back(next_observable.subscribe(
-                    [](const typename ObservableOfObservable::value_type::value_type &) { /* No-op */ },
-                    [alive_vec_ptr, alive_sub_ptr, subscriber, next_observable, lock](std::exception_ptr) {
-                      std::unique_lock<std::mutex> guard(*lock);
-                      remove_observable(remove_const(*alive_vec_ptr),
-                                        remove_const(*alive_sub_ptr),
-                                        next_observable);
-                      subscriber.on_next(*alive_vec_ptr);
-                    },
-                    [alive_vec_ptr, alive_sub_ptr, subscriber, next_observable, lock]() {
-                      std::unique_lock<std::mutex> guard(*lock);
-                      remove_observable(remove_const(*alive_vec_ptr),
-                                        remove_const(*alive_sub_ptr),
-                                        next_observable);
-                      subscriber.on_next(*alive_vec_ptr);
-                    }));
-                }
-                subscriber.on_next(*alive_vec_ptr);
+            if (end_policy == InstanceEndPolicy::DISPOSE)
+              writer.dispose_instance(handle);
+            else
+              writer.unregister_instance(handle);
+          }
+
+          void end(const Key & key)
+          {
+            dds::core::InstanceHandle handle = handles.erase(key);
+            if (!handle.is_nil())
+              end_instance(handle);
+          }
+
+          void end_all()
+          {
+            handles.drain([this](const dds::core::InstanceHandle & handle) {
+              end_instance(handle);
+            });
+          }
+        };
+
+        dds::pub::DataWriter<T> data_writer = data_writer_;
+        InstanceEndPolicy end_policy = end_policy_;
+
+        return rxcpp::observable<>::create<T>(
+          [prev, data_writer, end_policy](rxcpp::subscriber<T> subscriber)
+        {
+          auto state = std::make_shared<WriterState>(data_writer, end_policy);
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          auto fail = [state, subscriber, subscription](std::exception_ptr eptr) {
+            try {
+              state->end_all();
+            }
+            catch (...)
+            {
+              // eptr is the error to report.
+            }
+            subscriber.on_error(eptr);
+            subscription.unsubscribe();
+          };
+
+          subscription.add(prev.subscribe(
+            [state, subscriber, subscription, fail](const Group & group)
+          {
+            Key key = grouped_key(group);
+            rxcpp::composite_subscription group_subscription;
+            auto token = subscription.add(group_subscription);
+            state->active_groups++;
+
+            grouped_values(group).subscribe(
+              group_subscription,
+              [state, subscriber, key, fail](const T & t)
+            {
+              try {
+                state->writer.write(t, state->handles.handle(state->writer, key, t));
+              }
+              catch (...)
+              {
+                fail(std::current_exception());
+                return;
+              }
+              subscriber.on_next(t);
             },
-            [alive_vec_ptr, alive_sub_ptr, subscriber, lock](std::exception_ptr eptr) {
-                std::unique_lock<std::mutex> guard(*lock);
-                subscriber.on_error(eptr);
-                remove_const(alive_vec_ptr).reset();
-                remove_const(alive_sub_ptr).reset();
+              [fail](std::exception_ptr eptr)
+            {
+              fail(eptr);
             },
-              [alive_vec_ptr, alive_sub_ptr, subscriber, lock]() {
-                std::unique_lock<std::mutex> guard(*lock);
+              [state, subscriber, subscription, key, token, fail]()
+            {
+              try {
+                state->end(key);
+              }
+              catch (...)
+              {
+                fail(std::current_exception());
+                return;
+              }
+
+              subscription.remove(token);
+              if ((--state->active_groups == 0) && state->source_completed)
                 subscriber.on_completed();
-                remove_const(alive_vec_ptr).reset();
-                remove_const(alive_sub_ptr).reset();
             });
-          });
+          },
+            fail,
+            [state, subscriber]()
+          {
+            state->source_completed = true;
+            if (state->active_groups == 0)
+              subscriber.on_completed();
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    // The instance key of a publish_over_dds_async() that doesn't 
+    // conflate.
+    struct NoInstanceKey
+    {
+      template <class U>
+      int operator ()(const U &) const
+      {
+        return 0;
       }
     };
 
-    class NoOpOnCompleted
-    {
-      public:
-        void operator ()() const { }
-    };
+    // A bounded queue between one producer (the pipeline) and one 
+    // consumer, a thread that writes everything queued since its last
+    // wakeup and then flushes the writer, so that the writes of one 
+    // batch go out together under a batching QoS. Under 
+    // CONFLATE_PER_INSTANCE, slots_ maps the key of each queued value
+    // to its slot in the ring, so the producer never calls into the 
+    // writer and never scans the queue.
+    //
+    // The thread is detached and keeps the publisher alive until it has
+    // drained the queue after close(), so neither close() nor the
+    // release of the last outside reference ever waits for the writer.
+    // The outcome (completion, or the first error of the upstream, of a
+    // write or of the dispose) goes to the subscriber from that thread.
+    template <class T, class KeySelector>
+    class AsyncPublisher
+      : public std::enable_shared_from_this<AsyncPublisher<T, KeySelector>>
+    {
+      typedef typename std::decay<
+        typename std::result_of<KeySelector(const T &)>::type>::type Key;
+
+      typedef std::chrono::steady_clock clock;
+
+      struct Entry
+      {
+        T value;
+        Key key;
+
+        Entry()
+          : value(),
+            key()
+        { }
+      };
+
+      dds::pub::DataWriter<T> writer_;
+      std::shared_ptr<const T> dispose_instance_;
+      OverflowPolicy policy_;
+      KeySelector key_selector_;
+      std::chrono::milliseconds drain_timeout_;
+      rxcpp::subscriber<T> subscriber_;
+
+      std::mutex lock_;
+      std::condition_variable not_empty_;
+      std::condition_variable not_full_;
+      std::vector<Entry> ring_;
+      std::unordered_map<Key, size_t> slots_;
+      size_t head_;
+      size_t count_;
+      bool closing_;
+      bool notify_on_close_;
+      std::exception_ptr upstream_error_;
+      std::exception_ptr error_;
+      unsigned long long dropped_;
+
+      // Steady clock ticks after which the writes still queued are 
+      // discarded; max() until close(). Read by the writer thread 
+      // between writes, without the lock.
+      std::atomic<long long> deadline_;
+
+      bool past_deadline() const
+      {
+        long long deadline = deadline_.load();
+        return (deadline != (std::numeric_limits<long long>::max)()) &&
+               (clock::now().time_since_epoch().count() >= deadline);
+      }
+
+      void drop_oldest()
+      {
+        if (policy_ == OverflowPolicy::CONFLATE_PER_INSTANCE)
+          slots_.erase(ring_[head_].key);
+
+        head_ = (head_ + 1) % ring_.size();
+        count_--;
+        dropped_++;
+      }
+
+      void run()
+      {
+        std::vector<Entry> batch;
+        batch.reserve(ring_.size());
+
+        for (;;)
+        {
+          {
+            std::unique_lock<std::mutex> guard(lock_);
+            not_empty_.wait(guard, [this]() { return (count_ > 0) || closing_; });
+
+            if (closing_ && past_deadline())
+            {
+              dropped_ += count_;
+              head_ = (head_ + count_) % ring_.size();
+              count_ = 0;
+            }
+
+            if ((count_ == 0) && closing_)
+              break;
+
+            for (; count_ > 0; --count_)
+            {
+              batch.push_back(std::move(ring_[head_]));
+              head_ = (head_ + 1) % ring_.size();
+            }
+            slots_.clear();
+          }
+          not_full_.notify_all();
+
+          size_t written = 0;
+          try {
+            for (; (written < batch.size()) && !past_deadline(); ++written)
+              writer_.write(batch[written].value);
+            writer_->flush();
+          }
+          catch (...)
+          {
+            std::unique_lock<std::mutex> guard(lock_);
+            if (!error_)
+              error_ = std::current_exception();
+          }
+
+          if (written < batch.size())
+          {
+            std::unique_lock<std::mutex> guard(lock_);
+            dropped_ += batch.size() - written;
+          }
+          batch.clear();
+        }
+
+        finish();
+      }
+
+      void finish()
+      {
+        std::exception_ptr error;
+        bool notify;
+        {
+          std::unique_lock<std::mutex> guard(lock_);
+          error = upstream_error_ ? upstream_error_ : error_;
+          notify = notify_on_close_;
+        }
+
+        // Only a source that has ended disposes the instance; a 
+        // cancelled subscription leaves it alone.
+        if (notify)
+        {
+          try {
+            PublishOverDDSOp<T>::dispose(writer_, *dispose_instance_);
+          }
+          catch (...)
+          {
+            if (!error)
+              error = std::current_exception();
+          }
+
+          if (error)
+            subscriber_.on_error(error);
+          else
+            subscriber_.on_completed();
+        }
+      }
+
+      void close(bool notify, std::exception_ptr eptr)
+      {
+        {
+          std::unique_lock<std::mutex> guard(lock_);
+          if (closing_)
+            return;
+
+          closing_ = true;
+          notify_on_close_ = notify;
+          upstream_error_ = eptr;
+          deadline_ = (clock::now() + drain_timeout_).time_since_epoch().count();
+        }
+        not_empty_.notify_one();
+      }
+
+    public:
+
+      AsyncPublisher(dds::pub::DataWriter<T> writer,
+                     std::shared_ptr<const T> dispose_instance,
+                     size_t capacity,
+                     OverflowPolicy policy,
+                     KeySelector key_selector,
+                     std::chrono::milliseconds drain_timeout,
+                     rxcpp::subscriber<T> subscriber)
+        : writer_(writer),
+          dispose_instance_(dispose_instance),
+          policy_(policy),
+          key_selector_(key_selector),
+          drain_timeout_(drain_timeout),
+          subscriber_(subscriber),
+          ring_(capacity ? capacity : 1),
+          head_(0),
+          count_(0),
+          closing_(false),
+          notify_on_close_(false),
+          dropped_(0),
+          deadline_((std::numeric_limits<long long>::max)())
+      { 
+        if (policy_ == OverflowPolicy::CONFLATE_PER_INSTANCE)
+          slots_.reserve(ring_.size());
+      }
+
+      // Starts the writer thread, which holds on to the publisher 
+      // until it is done.
+      void start()
+      {
+        std::shared_ptr<AsyncPublisher> self = this->shared_from_this();
+        std::thread([self]() { self->run(); }).detach();
+      }
+
+      // Rethrows the first error of the writer thread, if any.
+      void push(const T & t)
+      {
+        const Key & key = key_selector_(t);
+
+        std::unique_lock<std::mutex> guard(lock_);
+        if (error_)
+          std::rethrow_exception(error_);
+
+        if (policy_ == OverflowPolicy::CONFLATE_PER_INSTANCE)
+        {
+          typename std::unordered_map<Key, size_t>::iterator slot = slots_.find(key);
+          if (slot != slots_.end())
+          {
+            ring_[slot->second].value = t;
+            dropped_++;
+            return;
+          }
+        }
+
+        if (count_ == ring_.size())
+        {
+          if (policy_ == OverflowPolicy::BLOCK)
+            not_full_.wait(guard, [this]() { return count_ < ring_.size(); });
+          else
+            drop_oldest();
+        }
+
+        size_t index = (head_ + count_) % ring_.size();
+        ring_[index].value = t;
+        if (policy_ == OverflowPolicy::CONFLATE_PER_INSTANCE)
+        {
+          ring_[index].key = key;
+          slots_.insert(std::make_pair(key, index));
+        }
+        count_++;
+
+        guard.unlock();
+        not_empty_.notify_one();
+      }
+
+      // The source has ended, with eptr if it failed. The writer thread
+      // gets drain_timeout to write what is queued, disposes the 
+      // instance and then completes the subscriber, or fails it with 
+      // eptr or its own first error. Doesn't wait for it.
+      void complete(std::exception_ptr eptr)
+      {
+        close(true, eptr);
+      }
+
+      // The subscription is gone. The writer thread gets drain_timeout
+      // to write what is queued and then ends quietly.
+      void cancel()
+      {
+        close(false, std::exception_ptr());
+      }
+
+      unsigned long long dropped()
+      {
+        std::unique_lock<std::mutex> guard(lock_);
+        return dropped_;
+      }
+    };
+
+    template <class T, class KeySelector>
+    class AsyncPublishOverDDSOp
+    {
+      dds::pub::DataWriter<T> data_writer_;
+      std::shared_ptr<const T> dispose_instance_;
+      size_t capacity_;
+      OverflowPolicy policy_;
+      KeySelector key_selector_;
+      std::chrono::milliseconds drain_timeout_;
+
+    public:
+
+      AsyncPublishOverDDSOp(dds::pub::DataWriter<T> datawriter,
+                            const T & instance,
+                            size_t capacity,
+                            OverflowPolicy policy,
+                            KeySelector key_selector,
+                            std::chrono::milliseconds drain_timeout)
+        : data_writer_(datawriter),
+          dispose_instance_(std::make_shared<const T>(instance)),
+          capacity_(capacity),
+          policy_(policy),
+          key_selector_(key_selector),
+          drain_timeout_(drain_timeout)
+      { }
+
+      rxcpp::observable<T> operator ()(rxcpp::observable<T> prev) const
+      {
+        dds::pub::DataWriter<T> data_writer = data_writer_;
+        std::shared_ptr<const T> instance = dispose_instance_;
+        size_t capacity = capacity_;
+        OverflowPolicy policy = policy_;
+        KeySelector key_selector = key_selector_;
+        std::chrono::milliseconds drain_timeout = drain_timeout_;
+
+        return rxcpp::observable<>::create<T>(
+          [prev, data_writer, instance, capacity, policy, key_selector, drain_timeout](rxcpp::subscriber<T> subscriber)
+        {
+          typedef AsyncPublisher<T, KeySelector> Publisher;
+
+          auto publisher = 
+            std::make_shared<Publisher>(
+              data_writer, instance, capacity, policy, key_selector, drain_timeout, subscriber);
+          publisher->start();
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          // Completion comes from the writer thread, which holds the
+          // publisher; this only makes sure the thread ends.
+          std::weak_ptr<Publisher> weak_publisher = publisher;
+          subscription.add(rxcpp::make_subscription([weak_publisher]() {
+            if (std::shared_ptr<Publisher> publisher = weak_publisher.lock())
+              publisher->cancel();
+          }));
+
+          subscription.add(prev.subscribe(
+            [publisher, subscriber, subscription](const T & t)
+          {
+            try {
+              publisher->push(t);
+              subscriber.on_next(t);
+            }
+            catch (...)
+            {
+              publisher->cancel();
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [publisher](std::exception_ptr eptr)
+          {
+            publisher->complete(eptr);
+          },
+            [publisher]()
+          {
+            publisher->complete(std::exception_ptr());
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    // What shed_on_backpressure keeps while the writer is congested.
+    template <class U>
+    class DropOldestBuffer
+    {
+      std::deque<U> values_;
+      size_t capacity_;
+
+    public:
+
+      explicit DropOldestBuffer(size_t capacity)
+        : capacity_(capacity ? capacity : 1)
+      { }
+
+      void push(const U & u)
+      {
+        if (values_.size() == capacity_)
+          values_.pop_front();
+        values_.push_back(u);
+      }
+
+      template <class Func>
+      void drain(Func func)
+      {
+        while (!values_.empty())
+        {
+          U u = std::move(values_.front());
+          values_.pop_front();
+          func(u);
+        }
+      }
+    };
+
+    // The latest value per key, in the order the keys first showed up.
+    template <class U, class KeySelector>
+    class ConflateBuffer
+    {
+      typedef typename std::decay<
+        typename std::result_of<KeySelector(const U &)>::type>::type Key;
+
+      KeySelector key_selector_;
+      std::vector<U> values_;
+      std::unordered_map<Key, size_t> slots_;
+
+    public:
+
+      explicit ConflateBuffer(KeySelector key_selector)
+        : key_selector_(key_selector)
+      { }
+
+      void push(const U & u)
+      {
+        typename std::unordered_map<Key, size_t>::iterator slot = slots_.find(key_selector_(u));
+        if (slot == slots_.end())
+        {
+          slots_.emplace(key_selector_(u), values_.size());
+          values_.push_back(u);
+        }
+        else
+          values_[slot->second] = u;
+      }
+
+      template <class Func>
+      void drain(Func func)
+      {
+        std::vector<U> values;
+        values.swap(values_);
+        slots_.clear();
+
+        for (const U & u : values)
+          func(u);
+      }
+    };
+
+    struct DropOldestShedding
+    {
+      size_t capacity;
+
+      template <class U>
+      DropOldestBuffer<U> make() const
+      {
+        return DropOldestBuffer<U>(capacity);
+      }
+    };
+
+    template <class KeySelector>
+    struct ConflateShedding
+    {
+      KeySelector key_selector;
+
+      template <class U>
+      ConflateBuffer<U, KeySelector> make() const
+      {
+        return ConflateBuffer<U, KeySelector>(key_selector);
+      }
+    };
+
+    // Forwards values while the writer keeps up. While it is congested,
+    // holds them back in a buffer made by Shedding, and forwards what is
+    // left of them once the writer recovers. The buffer is drained by 
+    // whichever thread polls the pressure, so it is only touched, and 
+    // values are only forwarded, under the lock of the pressure.
+    template <class W, class Shedding>
+    class ShedOnBackpressureOp
+    {
+      WriterBackpressure<W> pressure_;
+      Shedding shedding_;
+
+    public:
+
+      ShedOnBackpressureOp(WriterBackpressure<W> pressure, Shedding shedding)
+        : pressure_(pressure),
+          shedding_(shedding)
+      { }
+
+      template <class Observable>
+      rxcpp::observable<typename Observable::value_type> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type U;
+        typedef decltype(shedding_.template make<U>()) Buffer;
+
+        WriterBackpressure<W> pressure = pressure_;
+        Shedding shedding = shedding_;
+
+        return rxcpp::observable<>::create<U>(
+          [prev, pressure, shedding](rxcpp::subscriber<U> subscriber)
+        {
+          auto buffer = std::make_shared<Buffer>(shedding.template make<U>());
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(pressure.create_observable().subscribe(
+            [buffer, subscriber](const WriterPressure & writer_pressure)
+          {
+            if (!writer_pressure.congested)
+              buffer->drain([&subscriber](const U & u) { subscriber.on_next(u); });
+          }));
+
+          subscription.add(prev.subscribe(
+            [pressure, buffer, subscriber, subscription](const U & u)
+          {
+            pressure.synchronize([&]() {
+              bool congested;
+              try {
+                congested = remove_const(pressure).poll();
+              }
+              catch (...)
+              {
+                subscriber.on_error(std::current_exception());
+                subscription.unsubscribe();
+                return;
+              }
+
+              if (congested)
+                buffer->push(u);
+              else
+                subscriber.on_next(u);
+            });
+          },
+            [pressure, subscriber](std::exception_ptr eptr)
+          {
+            pressure.synchronize([&]() { subscriber.on_error(eptr); });
+          },
+            [pressure, buffer, subscriber]()
+          {
+            pressure.synchronize([&]() {
+              buffer->drain([&subscriber](const U & u) { subscriber.on_next(u); });
+              subscriber.on_completed();
+            });
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    class PaceOp
+    {
+      double rate_;
+      double burst_;
+
+    public:
+
+      PaceOp(double rate, double burst)
+        : rate_(rate),
+          burst_(burst)
+      {
+        if (!(rate > 0))
+          throw std::invalid_argument("pace: rate must be positive");
+      }
+
+      template <class Observable>
+      rxcpp::observable<typename Observable::value_type> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+        double rate = rate_;
+        double burst = burst_;
+
+        return rxcpp::observable<>::create<T>(
+          [prev, rate, burst](rxcpp::subscriber<T> subscriber)
+        {
+          auto bucket = std::make_shared<TokenBucket>(rate, burst);
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [bucket, subscriber](const T & t)
+          {
+            bucket->acquire();
+            subscriber.on_next(t);
+          },
+            [subscriber](std::exception_ptr eptr)
+          {
+            subscriber.on_error(eptr);
+          },
+            [subscriber]()
+          {
+            subscriber.on_completed();
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    class CoalesceAliveOp
+    {
+    public:
+
+      template <class Observable>
+      static void remove_observable(
+        std::vector<Observable> & observable_vec,
+        std::vector<rxcpp::subscription> & subscription_vec,
+        Observable observable)
+      {
+        auto iter = std::find(observable_vec.begin(), observable_vec.end(), observable);
+        if (iter != observable_vec.end())
+        {
+          size_t index = iter - observable_vec.begin();
+          observable_vec.erase(iter);
+          subscription_vec.erase(subscription_vec.begin() + index);
+        }
+      }
+
+      template <class ObservableOfObservable>
+      rxcpp::observable<std::vector<typename ObservableOfObservable::value_type>>
+        operator ()(ObservableOfObservable prev) const
+      {
+        typedef std::vector<typename ObservableOfObservable::value_type> ResultType;
+        typedef std::vector<rxcpp::subscription> SubscriptionVecType;
+          
+        auto alive_vec_ptr = std::make_shared<ResultType> ();
+        auto alive_sub_ptr = std::make_shared<SubscriptionVecType>();
+        auto lock = std::make_shared<std::mutex>();
+
+        return rxcpp::observable<>::create<ResultType>(
+          [alive_vec_ptr, alive_sub_ptr, prev, lock](rxcpp::subscriber<ResultType> subscriber)
+          {
+            return prev.subscribe(
+              [alive_vec_ptr, alive_sub_ptr, subscriber, lock]
+              (typename ObservableOfObservable::value_type next_observable) {
+                std::unique_lock<std::mutex> guard(*lock);
+                auto & alive_vector = *detail::remove_const(alive_vec_ptr);
+                auto iter = std::find(alive_vector.begin(), alive_vector.end(), next_observable);
+                if (iter == alive_vector.end())
+                {
+                  alive_vector.push_back(next_observable);
+                  detail::remove_const(alive_sub_ptr)->push_back(next_observable.subscribe(
+                    [](const typename ObservableOfObservable::value_type::value_type &) { /* No-op */ },
+                    [alive_vec_ptr, alive_sub_ptr, subscriber, next_observable, lock](std::exception_ptr) {
+                      std::unique_lock<std::mutex> guard(*lock);
+                      remove_observable(remove_const(*alive_vec_ptr),
+                                        remove_const(*alive_sub_ptr),
+                                        next_observable);
+                      subscriber.on_next(*alive_vec_ptr);
+                    },
+                    [alive_vec_ptr, alive_sub_ptr, subscriber, next_observable, lock]() {
+                      std::unique_lock<std::mutex> guard(*lock);
+                      remove_observable(remove_const(*alive_vec_ptr),
+                                        remove_const(*alive_sub_ptr),
+                                        next_observable);
+                      subscriber.on_next(*alive_vec_ptr);
+                    }));
+                }
+                subscriber.on_next(*alive_vec_ptr);
+            },
+            [alive_vec_ptr, alive_sub_ptr, subscriber, lock](std::exception_ptr eptr) {
+                std::unique_lock<std::mutex> guard(*lock);
+                subscriber.on_error(eptr);
+                remove_const(alive_vec_ptr).reset();
+                remove_const(alive_sub_ptr).reset();
+            },
+              [alive_vec_ptr, alive_sub_ptr, subscriber, lock]() {
+                std::unique_lock<std::mutex> guard(*lock);
+                subscriber.on_completed();
+                remove_const(alive_vec_ptr).reset();
+                remove_const(alive_sub_ptr).reset();
+            });
+          });
+      }
+    };
+
+    class NoOpOnCompleted
+    {
+      public:
+        void operator ()() const { }
+    };
+
+    class NoOpOnError
+    {
+      public:
+        void operator ()(std::exception_ptr) const { }
+    };
+
+    template <class T>
+    struct CombineLatestSubscriptionState
+    {
+      std::mutex lock;
+      std::vector<T> result_vector;
+      std::vector<char> init_vector;
+      rxcpp::composite_subscription subscription;
+      size_t init_count;
+      size_t expected_count;
+      size_t completed_count;
+
+      explicit CombineLatestSubscriptionState(size_t expected)
+        : result_vector(expected, T()),
+          init_vector(expected, 0),
+          subscription(),
+          init_count(0),
+          expected_count(expected),
+          completed_count(0)
+      { }
+    };
+
+    class SourceTimestamp
+    {
+    public:
+
+      // Nanoseconds since the epoch, as stamped by the DataWriter.
+      template <class Sample>
+      long long operator ()(const Sample & sample) const
+      {
+        return sample_source_timestamp(sample);
+      }
+    };
+
+    template <class T>
+    class RingSpanIterator
+    {
+      T * pos_;
+      T * first_end_;
+      T * second_begin_;
+
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef T value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef T * pointer;
+      typedef T & reference;
+
+      RingSpanIterator(T * pos, T * first_end, T * second_begin)
+        : pos_(pos),
+          first_end_(first_end),
+          second_begin_(second_begin)
+      { }
+
+      reference operator *() const { return *pos_; }
+      pointer operator ->() const { return pos_; }
+
+      RingSpanIterator & operator ++()
+      {
+        ++pos_;
+        if (pos_ == first_end_)
+          pos_ = second_begin_;
+        return *this;
+      }
+
+      RingSpanIterator operator ++(int)
+      {
+        RingSpanIterator tmp = *this;
+        ++*this;
+        return tmp;
+      }
+
+      bool operator == (const RingSpanIterator & other) const { return pos_ == other.pos_; }
+      bool operator != (const RingSpanIterator & other) const { return pos_ != other.pos_; }
+    };
+
+    // A non-owning view of a contiguous run of ring buffer slots. 
+    // The run may wrap around the end of the storage, so it is kept 
+    // as (at most) two contiguous segments.
+    template <class T>
+    class RingSpan
+    {
+      T * first_begin_;
+      T * first_end_;
+      T * second_begin_;
+      T * second_end_;
+
+    public:
+      typedef RingSpanIterator<T> iterator;
+      typedef RingSpanIterator<T> const_iterator;
+
+      RingSpan()
+        : first_begin_(nullptr),
+          first_end_(nullptr),
+          second_begin_(nullptr),
+          second_end_(nullptr)
+      { }
+
+      RingSpan(T * first_begin, T * first_end, T * second_begin, T * second_end)
+        : first_begin_(first_begin),
+          first_end_(first_end),
+          second_begin_(second_begin),
+          second_end_(second_end)
+      {
+        // An empty second segment collapses onto the end of the first 
+        // so that end() is the same position whether or not we wrapped.
+        if (second_begin_ == second_end_)
+          second_begin_ = second_end_ = first_end_;
+      }
+
+      size_t size() const
+      {
+        return (first_end_ - first_begin_) + (second_end_ - second_begin_);
+      }
+
+      bool empty() const
+      {
+        return size() == 0;
+      }
+
+      T & operator [](size_t i) const
+      {
+        size_t first_size = first_end_ - first_begin_;
+        return (i < first_size) ? first_begin_[i] : second_begin_[i - first_size];
+      }
+
+      iterator begin() const
+      {
+        return iterator(first_begin_, first_end_, second_begin_);
+      }
+
+      iterator end() const
+      {
+        return iterator(second_end_, second_end_, second_end_);
+      }
+    };
+
+    // Growable FIFO over contiguous power-of-two storage. Popped slots
+    // are reset but never freed, so once the capacity has settled at 
+    // the high-water mark of the window pushes and pops don't allocate.
+    template <class T>
+    class RingBuffer
+    {
+      std::vector<T> slots_;
+      size_t head_;
+      size_t size_;
+      size_t mask_;
+
+      void grow()
+      {
+        std::vector<T> bigger(slots_.size() * 2);
+        for (size_t i = 0; i < size_; ++i)
+          bigger[i] = std::move((*this)[i]);
+
+        slots_.swap(bigger);
+        head_ = 0;
+        mask_ = slots_.size() - 1;
+      }
+
+    public:
+      explicit RingBuffer(size_t initial_capacity = 16)
+        : head_(0),
+          size_(0),
+          mask_(0)
+      {
+        size_t capacity = 1;
+        while (capacity < initial_capacity)
+          capacity *= 2;
+
+        slots_.resize(capacity);
+        mask_ = capacity - 1;
+      }
+
+      size_t size() const { return size_; }
+      bool empty() const { return size_ == 0; }
+      size_t capacity() const { return slots_.size(); }
+
+      T & operator [](size_t i) { return slots_[(head_ + i) & mask_]; }
+      const T & operator [](size_t i) const { return slots_[(head_ + i) & mask_]; }
+
+      T & front() { return slots_[head_]; }
+      T & back() { return (*this)[size_ - 1]; }
+
+      // Makes room for one more element without disturbing the 
+      // elements already in the buffer (including ones about to be popped).
+      void reserve_one()
+      {
+        if (size_ == slots_.size())
+          grow();
+      }
+
+      void push_back(const T & t)
+      {
+        reserve_one();
+        slots_[(head_ + size_) & mask_] = t;
+        ++size_;
+      }
+
+      void push_back(T && t)
+      {
+        reserve_one();
+        slots_[(head_ + size_) & mask_] = std::move(t);
+        ++size_;
+      }
+
+      void pop_front(size_t count = 1)
+      {
+        for (size_t i = 0; i < count; ++i)
+        {
+          slots_[head_] = T();
+          head_ = (head_ + 1) & mask_;
+        }
+        size_ -= count;
+      }
+
+      void clear()
+      {
+        pop_front(size_);
+        head_ = 0;
+      }
+
+      RingSpan<T> first(size_t count)
+      {
+        T * base = slots_.data();
+        size_t first_size = std::min(count, slots_.size() - head_);
+        return RingSpan<T>(base + head_, 
+                           base + head_ + first_size,
+                           base,
+                           base + (count - first_size));
+      }
+    };
+
+    template <class TimestampFn, class Seed, class Accumulator>
+    class TimeWindowAggregateOp
+    {
+      long long window_;
+      TimestampFn timestamp_fn_;
+      Seed seed_;
+      Accumulator accumulator_;
+
+    public:
+
+      TimeWindowAggregateOp(long long window,
+                            TimestampFn timestamp_fn,
+                            Seed seed,
+                            Accumulator accumulator)
+        : window_(window),
+          timestamp_fn_(std::move(timestamp_fn)),
+          seed_(std::move(seed)),
+          accumulator_(std::move(accumulator))
+      { }
+
+      template <class Observable>
+      rxcpp::observable<Seed> operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+        typedef typename owned_value<T>::type V;
+
+        // Timestamps live in a ring of their own, in lock-step with the 
+        // values, so that the expired values are contiguous V's.
+        struct WindowState
+        {
+          RingBuffer<long long> timestamps;
+          RingBuffer<V> values;
+          Seed seed;
+
+          explicit WindowState(const Seed & s)
+            : seed(s)
+          { }
+        };
+
+        long long window = window_;
+        TimestampFn timestamp_fn = timestamp_fn_;
+        Seed seed = seed_;
+        Accumulator accumulator = accumulator_;
+
+        return rxcpp::observable<>::create<Seed>(
+          [prev, window, timestamp_fn, seed, accumulator](rxcpp::subscriber<Seed> subscriber)
+        {
+          auto state = std::make_shared<WindowState>(seed);
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, state, window, timestamp_fn, accumulator](const T & t)
+          {
+            try {
+              long long now = remove_const(timestamp_fn)(t);
+              RingBuffer<long long> & timestamps = state->timestamps;
+              RingBuffer<V> & values = state->values;
+
+              size_t expired = 0;
+              while ((expired < timestamps.size()) && 
+                     (now - timestamps[expired] > window))
+                ++expired;
+
+              // The expired values stay in place while the accumulator 
+              // looks at them. reserve_one() guarantees that the new value
+              // does not land on top of them.
+              values.reserve_one();
+              RingSpan<V> expired_values = values.first(expired);
+              timestamps.push_back(now);
+              values.push_back(owned_value<T>::make(t));
+
+              state->seed = 
+                remove_const(accumulator)(std::move(state->seed), 
+                                          values.back(), 
+                                          expired_values, 
+                                          values.size() - expired);
+              timestamps.pop_front(expired);
+              values.pop_front(expired);
+              subscriber.on_next(state->seed);
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber]() { subscriber.on_completed(); }));
+
+          return subscription;
+        });
+      }
+    };
+
+    // FIFO aggregator for an associative (not necessarily invertible or
+    // commutative) combine function. The front stack holds suffix 
+    // aggregates of the oldest elements, the back stack the newest 
+    // values and their running aggregate. Pops flip the back stack onto
+    // the front only when the front runs dry, so push, pop and query are
+    // amortized O(1).
+    template <class T, class Combine>
+    class TwoStackAggregator
+    {
+      Combine combine_;
+      std::vector<T> front_aggregates_;
+      std::vector<T> back_values_;
+      T back_aggregate_;
+
+      void flip()
+      {
+        while (!back_values_.empty())
+        {
+          if (front_aggregates_.empty())
+            front_aggregates_.push_back(back_values_.back());
+          else
+            front_aggregates_.push_back(combine_(back_values_.back(), front_aggregates_.back()));
+
+          back_values_.pop_back();
+        }
+      }
+
+    public:
+      explicit TwoStackAggregator(Combine combine)
+        : combine_(std::move(combine)),
+          back_aggregate_()
+      { }
+
+      size_t size() const 
+      { 
+        return front_aggregates_.size() + back_values_.size(); 
+      }
+
+      bool empty() const 
+      { 
+        return size() == 0; 
+      }
+
+      void push(const T & t)
+      {
+        if (back_values_.empty())
+          back_aggregate_ = t;
+        else
+          back_aggregate_ = combine_(back_aggregate_, t);
+
+        back_values_.push_back(t);
+      }
+
+      void pop()
+      {
+        if (front_aggregates_.empty())
+          flip();
+
+        front_aggregates_.pop_back();
+      }
+
+      // Precondition: !empty()
+      T query()
+      {
+        if (front_aggregates_.empty())
+          return back_aggregate_;
+        else if (back_values_.empty())
+          return front_aggregates_.back();
+        else
+          return combine_(front_aggregates_.back(), back_aggregate_);
+      }
+    };
+
+    template <class Combine>
+    class CountWindowCombineOp
+    {
+      size_t count_;
+      Combine combine_;
+
+    public:
+
+      CountWindowCombineOp(size_t count, Combine combine)
+        : count_(count),
+          combine_(std::move(combine))
+      {
+        if (count_ == 0)
+          throw std::invalid_argument("window_aggregate: window size must be positive");
+      }
+
+      // The window holds owned values (see owned_value), so samples come
+      // out, and are combined, as owned Sample<T>s.
+      template <class Observable>
+      rxcpp::observable<typename owned_value<typename Observable::value_type>::type> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+        typedef typename owned_value<T>::type V;
+
+        size_t count = count_;
+        Combine combine = combine_;
+
+        return rxcpp::observable<>::create<V>(
+          [prev, count, combine](rxcpp::subscriber<V> subscriber)
+        {
+          auto window = std::make_shared<TwoStackAggregator<V, Combine>>(combine);
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, window, count](const T & t)
+          {
+            try {
+              window->push(owned_value<T>::make(t));
+              if (window->size() > count)
+                window->pop();
+
+              subscriber.on_next(window->query());
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber]() { subscriber.on_completed(); }));
+
+          return subscription;
+        });
+      }
+    };
+
+    template <class TimestampFn, class Combine>
+    class TimeWindowCombineOp
+    {
+      long long window_;
+      TimestampFn timestamp_fn_;
+      Combine combine_;
+
+    public:
+
+      TimeWindowCombineOp(long long window,
+                          TimestampFn timestamp_fn,
+                          Combine combine)
+        : window_(window),
+          timestamp_fn_(std::move(timestamp_fn)),
+          combine_(std::move(combine))
+      { }
+
+      // Like CountWindowCombineOp, samples are held and come out as 
+      // owned Sample<T>s.
+      template <class Observable>
+      rxcpp::observable<typename owned_value<typename Observable::value_type>::type> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+        typedef typename owned_value<T>::type V;
+
+        struct WindowState
+        {
+          RingBuffer<long long> timestamps;
+          TwoStackAggregator<V, Combine> aggregator;
+
+          explicit WindowState(const Combine & combine)
+            : aggregator(combine)
+          { }
+        };
+
+        long long window = window_;
+        TimestampFn timestamp_fn = timestamp_fn_;
+        Combine combine = combine_;
+
+        return rxcpp::observable<>::create<V>(
+          [prev, window, timestamp_fn, combine](rxcpp::subscriber<V> subscriber)
+        {
+          auto state = std::make_shared<WindowState>(combine);
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, state, window, timestamp_fn](const T & t)
+          {
+            try {
+              long long now = remove_const(timestamp_fn)(t);
+
+              while (!state->timestamps.empty() &&
+                     (now - state->timestamps.front() > window))
+              {
+                state->timestamps.pop_front();
+                state->aggregator.pop();
+              }
+
+              state->timestamps.push_back(now);
+              state->aggregator.push(owned_value<T>::make(t));
+              subscriber.on_next(state->aggregator.query());
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber]() { subscriber.on_completed(); }));
+
+          return subscription;
+        });
+      }
+    };
+
+    inline long long gcd(long long a, long long b)
+    {
+      while (b != 0)
+      {
+        long long r = a % b;
+        a = b;
+        b = r;
+      }
+      return a;
+    }
+
+    inline long long floor_div(long long a, long long b)
+    {
+      long long q = a / b;
+      return ((a % b != 0) && ((a < 0) != (b < 0))) ? q - 1 : q;
+    }
+
+    // One of the windows of a MultiWindowAggregateOp. It only ever sees
+    // pane aggregates, never raw samples. A length of zero panes means
+    // the window is unbounded (e.g. the full game).
+    template <class A, class Combine>
+    class PaneWindow
+    {
+      long long panes_;
+      Combine combine_;
+      RingBuffer<long long> pane_ids_;
+      TwoStackAggregator<A, Combine> aggregator_;
+      A total_;
+
+    public:
+      PaneWindow(long long panes, Combine combine)
+        : panes_(panes),
+          combine_(combine),
+          aggregator_(std::move(combine)),
+          total_()
+      { }
+
+      void add_pane(long long pane_id, const A & pane, bool first_pane)
+      {
+        if (panes_ == 0)
+        {
+          total_ = first_pane ? pane : combine_(total_, pane);
+          return;
+        }
+
+        aggregator_.push(pane);
+        pane_ids_.push_back(pane_id);
+
+        while (pane_id - pane_ids_.front() >= panes_)
+        {
+          pane_ids_.pop_front();
+          aggregator_.pop();
+        }
+      }
+
+      A query()
+      {
+        return (panes_ == 0) ? total_ : aggregator_.query();
+      }
+    };
+
+    template <class TimestampFn, class Lift, class Combine>
+    class MultiWindowAggregateOp
+    {
+      std::vector<long long> window_lengths_;
+      long long pane_length_;
+      TimestampFn timestamp_fn_;
+      Lift lift_;
+      Combine combine_;
+
+    public:
+
+      MultiWindowAggregateOp(std::vector<long long> window_lengths,
+                             TimestampFn timestamp_fn,
+                             Lift lift,
+                             Combine combine)
+        : window_lengths_(std::move(window_lengths)),
+          pane_length_(0),
+          timestamp_fn_(std::move(timestamp_fn)),
+          lift_(std::move(lift)),
+          combine_(std::move(combine))
+      {
+        for (auto length : window_lengths_)
+        {
+          if (length < 0)
+            throw std::invalid_argument("multi_window_aggregate: window length can't be negative");
+
+          pane_length_ = gcd(pane_length_, length);
+        }
+
+        if (pane_length_ == 0)
+          throw std::invalid_argument("multi_window_aggregate: at least one bounded window is required");
+      }
+
+      template <class Observable,
+                class A = typename std::decay<
+                  typename std::result_of<Lift(const typename Observable::value_type &)>::type>::type>
+      rxcpp::observable<std::vector<A>> operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+
+        struct PaneState
+        {
+          std::vector<PaneWindow<A, Combine>> windows;
+          bool pane_open;
+          bool first_pane;
+          long long pane_id;
+          A pane;
+
+          PaneState()
+            : pane_open(false),
+              first_pane(true),
+              pane_id(0),
+              pane()
+          { }
+
+          std::vector<A> close_pane()
+          {
+            std::vector<A> result;
+            result.reserve(windows.size());
+
+            for (auto & window : windows)
+            {
+              window.add_pane(pane_id, pane, first_pane);
+              result.push_back(window.query());
+            }
+
+            first_pane = false;
+            pane_open = false;
+            return result;
+          }
+        };
+
+        std::vector<long long> window_lengths = window_lengths_;
+        long long pane_length = pane_length_;
+        TimestampFn timestamp_fn = timestamp_fn_;
+        Lift lift = lift_;
+        Combine combine = combine_;
+
+        return rxcpp::observable<>::create<std::vector<A>>(
+          [prev, window_lengths, pane_length, timestamp_fn, lift, combine]
+          (rxcpp::subscriber<std::vector<A>> subscriber)
+        {
+          auto state = std::make_shared<PaneState>();
+          for (auto length : window_lengths)
+            state->windows.push_back(PaneWindow<A, Combine>(length / pane_length, combine));
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, state, pane_length, timestamp_fn, lift, combine](const T & t)
+          {
+            try {
+              long long pane_id = floor_div(remove_const(timestamp_fn)(t), pane_length);
+
+              // Late samples are folded into the current pane. 
+              if (state->pane_open && (pane_id > state->pane_id))
+                subscriber.on_next(state->close_pane());
+
+              if (state->pane_open)
+              {
+                state->pane = remove_const(combine)(state->pane, remove_const(lift)(t));
+              }
+              else
+              {
+                state->pane = remove_const(lift)(t);
+                state->pane_id = pane_id;
+                state->pane_open = true;
+              }
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber, state]() 
+          { 
+            if (state->pane_open)
+              subscriber.on_next(state->close_pane());
+
+            subscriber.on_completed(); 
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    template <class Seed, class OnAdd, class OnRemove>
+    class ActiveKeyScanOp
+    {
+      Seed seed_;
+      OnAdd on_add_;
+      OnRemove on_remove_;
+
+    public:
+
+      ActiveKeyScanOp(Seed seed, OnAdd on_add, OnRemove on_remove)
+        : seed_(std::move(seed)),
+          on_add_(std::move(on_add)),
+          on_remove_(std::move(on_remove))
+      { }
+
+      template <class ObservableOfObservable>
+      rxcpp::observable<Seed> operator ()(ObservableOfObservable prev) const
+      {
+        typedef typename ObservableOfObservable::value_type InnerObservable;
+
+        struct ScanState
+        {
+          std::mutex lock;
+          Seed seed;
+          size_t active_count;
+          bool completed;
+          rxcpp::composite_subscription subscription;
+
+          explicit ScanState(const Seed & s)
+            : seed(s),
+              active_count(0),
+              completed(false)
+          { }
+        };
+
+        Seed seed = seed_;
+        OnAdd on_add = on_add_;
+        OnRemove on_remove = on_remove_;
+
+        return rxcpp::observable<>::create<Seed>(
+          [prev, seed, on_add, on_remove](rxcpp::subscriber<Seed> subscriber)
+        {
+          auto state = std::make_shared<ScanState>(seed);
+
+          state->subscription.add(prev.subscribe(
+            [state, subscriber, on_add, on_remove](InnerObservable inner)
+          {
+            {
+              std::unique_lock<std::mutex> guard(state->lock);
+              try {
+                state->seed = remove_const(on_add)(std::move(state->seed), inner);
+              }
+              catch (...)
+              {
+                subscriber.on_error(std::current_exception());
+                state->subscription.unsubscribe();
+                return;
+              }
+              state->active_count++;
+              /* Ensure Rx contract: Not to invoke observers concurrently.
+                 Therefore, on_next call is inside guard. */
+              subscriber.on_next(state->seed);
+            }
+
+            auto drop = [state, subscriber, on_remove, inner]()
+            {
+              std::unique_lock<std::mutex> guard(state->lock);
+              try {
+                state->seed = remove_const(on_remove)(std::move(state->seed), inner);
+              }
+              catch (...)
+              {
+                subscriber.on_error(std::current_exception());
+                state->subscription.unsubscribe();
+                return;
+              }
+              state->active_count--;
+              subscriber.on_next(state->seed);
+
+              if (state->completed && (state->active_count == 0))
+                subscriber.on_completed();
+            };
+
+            // The inner subscription takes itself out of the composite 
+            // when the stream ends so that instance churn doesn't pile up 
+            // dead subscriptions.
+            rxcpp::composite_subscription inner_subscription;
+            rxcpp::composite_subscription outer_subscription = state->subscription;
+            auto token = outer_subscription.add(inner_subscription);
+            inner_subscription.add(rxcpp::make_subscription([outer_subscription, token]() {
+              outer_subscription.remove(token);
+            }));
+
+            inner.subscribe(
+              inner_subscription,
+              [](const typename InnerObservable::value_type &) { /* No-op */ },
+              [drop](std::exception_ptr) { drop(); },
+              [drop]() { drop(); });
+          },
+            [state, subscriber](std::exception_ptr eptr)
+          {
+            std::unique_lock<std::mutex> guard(state->lock);
+            subscriber.on_error(eptr);
+          },
+            [state, subscriber]()
+          {
+            std::unique_lock<std::mutex> guard(state->lock);
+            state->completed = true;
+            if (state->active_count == 0)
+              subscriber.on_completed();
+          }));
+
+          return state->subscription;
+        });
+      }
+    };
+
+    class DropLateData
+    {
+    public:
+      template <class T>
+      void operator ()(const T &, long long) const { }
+    };
+
+    template <class TimestampFn, class LateHandler>
+    class AssignWatermarksOp
+    {
+      TimestampFn timestamp_fn_;
+      long long max_lateness_;
+      LateHandler late_handler_;
+
+    public:
+
+      AssignWatermarksOp(TimestampFn timestamp_fn,
+                         long long max_lateness,
+                         LateHandler late_handler)
+        : timestamp_fn_(std::move(timestamp_fn)),
+          max_lateness_(max_lateness),
+          late_handler_(std::move(late_handler))
+      { }
+
+      template <class Observable>
+      rxcpp::observable<Timestamped<typename Observable::value_type>> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+
+        struct WatermarkState
+        {
+          bool started;
+          long long max_timestamp;
+          long long watermark;
+
+          WatermarkState()
+            : started(false),
+              max_timestamp(0),
+              watermark(std::numeric_limits<long long>::min())
+          { }
+        };
+
+        TimestampFn timestamp_fn = timestamp_fn_;
+        long long max_lateness = max_lateness_;
+        LateHandler late_handler = late_handler_;
+
+        return rxcpp::observable<>::create<Timestamped<T>>(
+          [prev, timestamp_fn, max_lateness, late_handler](rxcpp::subscriber<Timestamped<T>> subscriber)
+        {
+          auto state = std::make_shared<WatermarkState>();
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, state, timestamp_fn, max_lateness, late_handler](const T & t)
+          {
+            try {
+              long long ts = remove_const(timestamp_fn)(t);
+
+              if (ts < state->watermark)
+              {
+                remove_const(late_handler)(t, ts);
+                return;
+              }
+
+              subscriber.on_next(Timestamped<T>(ts, t));
+
+              if (!state->started || (ts > state->max_timestamp))
+              {
+                state->started = true;
+                state->max_timestamp = ts;
+
+                if (ts - max_lateness > state->watermark)
+                {
+                  state->watermark = ts - max_lateness;
+                  subscriber.on_next(Timestamped<T>::watermark(state->watermark));
+                }
+              }
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber]() 
+          { 
+            // End of stream: nothing can be late anymore.
+            subscriber.on_next(Timestamped<T>::watermark(std::numeric_limits<long long>::max()));
+            subscriber.on_completed(); 
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    class DropWatermarksOp
+    {
+    public:
+
+      template <class Observable>
+      rxcpp::observable<typename Observable::value_type::value_type> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type::value_type T;
+
+        return prev
+          .filter([](const Timestamped<T> & t) { return !t.is_watermark; })
+          .map([](const Timestamped<T> & t) { return t.value; });
+      }
+    };
+
+    // Tumbling event-time windows. Only windows that got data are kept,
+    // by window index, and they are emitted and freed as soon as the 
+    // watermark passes their end, so the state is bounded by the 
+    // lateness of the stream rather than by its length or by the gaps in
+    // its timestamps. Data for a window that has already been emitted 
+    // goes to the late handler.
+    template <class Seed, class Accumulator, class LateHandler>
+    class TumblingEventWindowOp
+    {
+      long long length_;
+      Seed seed_;
+      Accumulator accumulator_;
+      LateHandler late_handler_;
+
+    public:
+
+      TumblingEventWindowOp(long long length, 
+                            Seed seed, 
+                            Accumulator accumulator,
+                            LateHandler late_handler)
+        : length_(length),
+          seed_(std::move(seed)),
+          accumulator_(std::move(accumulator)),
+          late_handler_(std::move(late_handler))
+      {
+        if (length_ <= 0)
+          throw std::invalid_argument("event_time_window: window length must be positive");
+      }
+
+      template <class Observable>
+      rxcpp::observable<EventWindow<Seed>> operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type::value_type T;
+
+        struct WindowState
+        {
+          std::map<long long, Seed> windows;
+          long long closed;   // Windows below this index have been emitted.
+
+          WindowState()
+            : closed(std::numeric_limits<long long>::min())
+          { }
+
+          void close_until(long long watermark, 
+                           long long length, 
+                           const rxcpp::subscriber<EventWindow<Seed>> & subscriber)
+          {
+            long long closed_until = floor_div(watermark, length);
+            if (closed_until <= closed)
+              return;
+
+            closed = closed_until;
+            while (!windows.empty() && (windows.begin()->first < closed))
+            {
+              long long index = windows.begin()->first;
+              EventWindow<Seed> result = { index * length, (index + 1) * length, windows.begin()->second };
+              windows.erase(windows.begin());
+              subscriber.on_next(result);
+            }
+          }
+        };
+
+        long long length = length_;
+        Seed seed = seed_;
+        Accumulator accumulator = accumulator_;
+        LateHandler late_handler = late_handler_;
+
+        return rxcpp::observable<>::create<EventWindow<Seed>>(
+          [prev, length, seed, accumulator, late_handler](rxcpp::subscriber<EventWindow<Seed>> subscriber)
+        {
+          auto state = std::make_shared<WindowState>();
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, state, length, seed, accumulator, late_handler]
+            (const Timestamped<T> & t)
+          {
+            try {
+              if (t.is_watermark)
+              {
+                state->close_until(t.timestamp, length, subscriber);
+                return;
+              }
+
+              long long index = floor_div(t.timestamp, length);
+              if (index < state->closed)
+              {
+                remove_const(late_handler)(t.value, t.timestamp);
+                return;
+              }
+
+              auto found = state->windows.lower_bound(index);
+              if ((found == state->windows.end()) || (found->first != index))
+                found = state->windows.emplace_hint(found, index, seed);
+
+              found->second = remove_const(accumulator)(std::move(found->second), t.value);
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber, state, length]()
+          {
+            state->close_until(std::numeric_limits<long long>::max(), length, subscriber);
+            subscriber.on_completed();
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    template <class TimestampFn>
+    class ReorderByTimestampOp
+    {
+      TimestampFn timestamp_fn_;
+      long long max_delay_;
+      size_t max_buffered_;
+      std::shared_ptr<ReorderStats> stats_;
+
+      static void count(std::atomic<unsigned long long> & counter)
+      {
+        counter.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      static void count_distance(std::atomic<long long> & max_distance, long long distance)
+      {
+        long long current = max_distance.load(std::memory_order_relaxed);
+        while ((distance > current) &&
+               !max_distance.compare_exchange_weak(current, distance, std::memory_order_relaxed))
+        { }
+      }
+
+    public:
+
+      ReorderByTimestampOp(TimestampFn timestamp_fn,
+                           long long max_delay,
+                           size_t max_buffered,
+                           std::shared_ptr<ReorderStats> stats)
+        : timestamp_fn_(std::move(timestamp_fn)),
+          max_delay_(max_delay),
+          max_buffered_(max_buffered),
+          stats_(stats ? stats : std::make_shared<ReorderStats>())
+      {
+        if (max_buffered_ == 0)
+          throw std::invalid_argument("reorder_by_timestamp: max_buffered must be positive");
+      }
+
+      // Samples are held as owned values (see owned_value), so a 
+      // LoanedSample<T> stream comes out as a Sample<T> stream.
+      template <class Observable>
+      rxcpp::observable<typename owned_value<typename Observable::value_type>::type> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+        typedef typename owned_value<T>::type V;
+
+        struct Entry
+        {
+          long long timestamp;
+          unsigned long long sequence;
+          V value;
+        };
+
+        // Min-heap on (timestamp, arrival order) so that samples with 
+        // equal timestamps keep their reception order.
+        struct Later
+        {
+          bool operator ()(const Entry & lhs, const Entry & rhs) const
+          {
+            return (lhs.timestamp > rhs.timestamp) ||
+                   ((lhs.timestamp == rhs.timestamp) && (lhs.sequence > rhs.sequence));
+          }
+        };
+
+        struct ReorderState
+        {
+          std::vector<Entry> heap;
+          unsigned long long sequence;
+          bool started;
+          long long max_timestamp;
+          bool released_any;
+          long long last_released;
+
+          ReorderState()
+            : sequence(0),
+              started(false),
+              max_timestamp(0),
+              released_any(false),
+              last_released(0)
+          { }
+
+          void release_top(const rxcpp::subscriber<V> & subscriber, ReorderStats & stats)
+          {
+            std::pop_heap(heap.begin(), heap.end(), Later());
+            last_released = heap.back().timestamp;
+            released_any = true;
+            count(stats.released);
+
+            V value = std::move(heap.back().value);
+            heap.pop_back();
+            subscriber.on_next(value);
+          }
+        };
+
+        TimestampFn timestamp_fn = timestamp_fn_;
+        long long max_delay = max_delay_;
+        size_t max_buffered = max_buffered_;
+        std::shared_ptr<ReorderStats> stats = stats_;
+
+        return rxcpp::observable<>::create<V>(
+          [prev, timestamp_fn, max_delay, max_buffered, stats](rxcpp::subscriber<V> subscriber)
+        {
+          auto state = std::make_shared<ReorderState>();
+          // The heap grows as needed; reserving max_buffered up front
+          // would cost every subscription that many samples.
+          state->heap.reserve(std::min<size_t>(max_buffered + 1, 256));
+
+          rxcpp::composite_subscription subscription;
+          subscription.add(rxcpp::composite_subscription::empty());
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, state, timestamp_fn, max_delay, max_buffered, stats](const T & t)
+          {
+            try {
+              long long ts = remove_const(timestamp_fn)(t);
+              count(stats->received);
+
+              // Anything older than what has already gone out can't be
+              // put back in order.
+              if (state->released_any && (ts < state->last_released))
+              {
+                count(stats->dropped);
+                return;
+              }
+
+              if (!state->started || (ts > state->max_timestamp))
+              {
+                state->started = true;
+                state->max_timestamp = ts;
+              }
+              else if (ts < state->max_timestamp)
+              {
+                count(stats->reordered);
+                count_distance(stats->max_reorder_distance, state->max_timestamp - ts);
+              }
+
+              Entry entry = { ts, state->sequence++, owned_value<T>::make(t) };
+              state->heap.push_back(std::move(entry));
+              std::push_heap(state->heap.begin(), state->heap.end(), Later());
+
+              long long watermark = state->max_timestamp - max_delay;
+              while (!state->heap.empty() && (state->heap.front().timestamp <= watermark))
+                state->release_top(subscriber, *stats);
+
+              while (state->heap.size() > max_buffered)
+              {
+                count(stats->forced_releases);
+                state->release_top(subscriber, *stats);
+              }
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber, state, stats]()
+          {
+            while (!state->heap.empty())
+              state->release_top(subscriber, *stats);
+
+            subscriber.on_completed();
+          }));
+
+          return subscription;
+        });
+      }
+    };
+
+    // Per-key buffer of a window join, kept in timestamp order. Samples
+    // mostly arrive in order, so an insertion is a push_back and, rarely,
+    // a few swaps towards the front.
+    template <class T>
+    class JoinBuffer
+    {
+      RingBuffer<Timestamped<T>> entries_;
+      long long scheduled_;
+
+    public:
+      JoinBuffer()
+        : scheduled_(std::numeric_limits<long long>::max())
+      { }
+
+      size_t size() const { return entries_.size(); }
+      bool empty() const { return entries_.empty(); }
+      const Timestamped<T> & operator [](size_t i) const { return entries_[i]; }
+
+      // The timestamp under which the buffer sits in its side's expiry heap.
+      long long scheduled() const { return scheduled_; }
+      void schedule(long long timestamp) { scheduled_ = timestamp; }
+
+      void insert(const Timestamped<T> & t)
+      {
+        entries_.push_back(t);
+        for (size_t i = entries_.size() - 1; 
+             (i > 0) && (entries_[i - 1].timestamp > entries_[i].timestamp); 
+             --i)
+        {
+          std::swap(entries_[i - 1], entries_[i]);
+        }
+      }
+
+      // Index of the first entry not older than timestamp.
+      size_t lower_bound(long long timestamp) const
+      {
+        size_t low = 0, high = entries_.size();
+        while (low < high)
+        {
+          size_t mid = low + (high - low) / 2;
+          if (entries_[mid].timestamp < timestamp)
+            low = mid + 1;
+          else
+            high = mid;
+        }
+        return low;
+      }
+
+      void evict_before(long long timestamp)
+      {
+        entries_.pop_front(lower_bound(timestamp));
+      }
+    };
+
+    template <class Key>
+    struct JoinExpiry
+    {
+      long long timestamp;
+      Key key;
+    };
+
+    template <class Key>
+    struct JoinExpiryLater
+    {
+      bool operator ()(const JoinExpiry<Key> & lhs, const JoinExpiry<Key> & rhs) const
+      {
+        return lhs.timestamp > rhs.timestamp;
+      }
+    };
+
+    // The buffers of one side of a window join, and a min-heap of when 
+    // the oldest entry of each buffer expires. A watermark only visits 
+    // the buffers that have something to evict, and buffers that run 
+    // empty are erased. A buffer is in the heap at most once that counts:
+    // at its scheduled() timestamp. Heap entries left behind when an older
+    // sample moved a buffer's schedule forward are skipped.
+    template <class T, class Key>
+    struct JoinSide
+    {
+      std::unordered_map<Key, JoinBuffer<T>> buffers;
+      std::vector<JoinExpiry<Key>> expiry;
+
+      void schedule(const Key & key, JoinBuffer<T> & buffer, long long timestamp)
+      {
+        buffer.schedule(timestamp);
+        JoinExpiry<Key> entry = { timestamp, key };
+        expiry.push_back(entry);
+        std::push_heap(expiry.begin(), expiry.end(), JoinExpiryLater<Key>());
+      }
+
+      void insert(const Key & key, const Timestamped<T> & t)
+      {
+        JoinBuffer<T> & buffer = buffers[key];
+        buffer.insert(t);
+        if (t.timestamp < buffer.scheduled())
+          schedule(key, buffer, t.timestamp);
+      }
+
+      // Samples of one side can't match anything on the other side once
+      // the other side's watermark is more than window past them.
+      void evict(long long other_watermark, long long window)
+      {
+        if (other_watermark == std::numeric_limits<long long>::min())
+          return;
+
+        if (other_watermark == std::numeric_limits<long long>::max())
+        {
+          buffers.clear();
+          expiry.clear();
+          return;
+        }
+
+        long long horizon = other_watermark - window;
+        while (!expiry.empty() && (expiry.front().timestamp < horizon))
+        {
+          std::pop_heap(expiry.begin(), expiry.end(), JoinExpiryLater<Key>());
+          JoinExpiry<Key> next = std::move(expiry.back());
+          expiry.pop_back();
+
+          auto found = buffers.find(next.key);
+          if ((found == buffers.end()) || (found->second.scheduled() != next.timestamp))
+            continue;
+
+          JoinBuffer<T> & buffer = found->second;
+          buffer.evict_before(horizon);
+          if (buffer.empty())
+            buffers.erase(found);
+          else
+            schedule(next.key, buffer, buffer[0].timestamp);
+        }
+      }
+    };
+
+    template <class L, class R, class Key>
+    struct WindowJoinState
+    {
+      std::mutex lock;
+      JoinSide<L, Key> left;
+      JoinSide<R, Key> right;
+      long long left_watermark;
+      long long right_watermark;
+      long long emitted_watermark;
+      int completed_count;
+      rxcpp::composite_subscription subscription;
+
+      WindowJoinState()
+        : left_watermark(std::numeric_limits<long long>::min()),
+          right_watermark(std::numeric_limits<long long>::min()),
+          emitted_watermark(std::numeric_limits<long long>::min()),
+          completed_count(0)
+      { }
+    };
+
+    // Probes the other side's buffer for the key and then keeps the 
+    // sample, unless the other side's watermark says that nothing it 
+    // could still match will ever arrive.
+    template <class Mine, class Other, class Key, class Emit>
+    void window_join_probe(const Timestamped<Mine> & t,
+                           const Key & key,
+                           long long window,
+                           long long other_watermark,
+                           JoinSide<Mine, Key> & mine,
+                           const JoinSide<Other, Key> & other,
+                           Emit emit)
+    {
+      auto found = other.buffers.find(key);
+      if (found != other.buffers.end())
+      {
+        const JoinBuffer<Other> & buffer = found->second;
+        for (size_t i = buffer.lower_bound(t.timestamp - window);
+             (i < buffer.size()) && (buffer[i].timestamp <= t.timestamp + window);
+             ++i)
+        {
+          emit(t, buffer[i]);
+        }
+      }
+
+      if (t.timestamp + window >= other_watermark)
+        mine.insert(key, t);
+    }
 
-    class NoOpOnError
+    template <class V, class TableKeySelector, class ProbeKeySelector>
+    class LookupJoinOp
     {
-      public:
-        void operator ()(std::exception_ptr) const { }
+      TopicSubscription<V> table_subscription_;
+      TableKeySelector table_key_selector_;
+      ProbeKeySelector probe_key_selector_;
+
+    public:
+
+      LookupJoinOp(TopicSubscription<V> table_subscription,
+                   TableKeySelector table_key_selector,
+                   ProbeKeySelector probe_key_selector)
+        : table_subscription_(table_subscription),
+          table_key_selector_(std::move(table_key_selector)),
+          probe_key_selector_(std::move(probe_key_selector))
+      { }
+
+      template <class Observable>
+      rxcpp::observable<std::pair<typename Observable::value_type, std::shared_ptr<const V>>>
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type T;
+        typedef std::pair<T, std::shared_ptr<const V>> Joined;
+        typedef typename std::decay<
+          typename std::result_of<TableKeySelector(const V &)>::type>::type Key;
+
+        // The table holds one immutable value per instance. Updates 
+        // replace the pointer, so a probe result handed downstream stays
+        // valid and is never copied. The table is written on the table
+        // subscription's thread and probed on prev's, hence the lock.
+        struct Row
+        {
+          dds::core::InstanceHandle handle;
+          std::shared_ptr<const V> value;
+        };
+
+        struct LookupTable
+        {
+          std::mutex lock;
+          std::unordered_map<Key, Row> rows;
+          std::unordered_map<dds::core::InstanceHandle, Key> instance_keys;
+
+          // Removes the row of key, unless another instance took it over.
+          void erase_row(const Key & key, const dds::core::InstanceHandle & handle)
+          {
+            auto found = rows.find(key);
+            if ((found != rows.end()) && (found->second.handle == handle))
+              rows.erase(found);
+          }
+        };
+
+        TopicSubscription<V> table_subscription = table_subscription_;
+        TableKeySelector table_key_selector = table_key_selector_;
+        ProbeKeySelector probe_key_selector = probe_key_selector_;
+
+        return rxcpp::observable<>::create<Joined>(
+          [prev, table_subscription, table_key_selector, probe_key_selector]
+          (rxcpp::subscriber<Joined> subscriber)
+        {
+          auto table = std::make_shared<LookupTable>();
+          rxcpp::composite_subscription subscription;
+
+          subscription.add(
+            remove_const(table_subscription).create_observable().subscribe(
+            [table, table_key_selector](const rti::sub::LoanedSample<V> & sample)
+          {
+            const dds::core::InstanceHandle & handle = sample.info().instance_handle();
+            unsigned char flags = sample_flags(sample);
+
+            if (flags & SAMPLE_VALID)
+            {
+              Key key = remove_const(table_key_selector)(sample.data());
+              Row row = { handle, std::make_shared<const V>(sample.data()) };
+
+              std::unique_lock<std::mutex> guard(table->lock);
+              auto known = table->instance_keys.find(handle);
+              if (known == table->instance_keys.end())
+                table->instance_keys.emplace(handle, key);
+              else if (!(known->second == key))
+              {
+                // The key field of the instance changed.
+                table->erase_row(known->second, handle);
+                known->second = key;
+              }
+              table->rows[key] = std::move(row);
+            }
+            else
+            {
+              // On no_writers the last known value is kept.
+              if (flags & SAMPLE_DISPOSED)
+              {
+                std::unique_lock<std::mutex> guard(table->lock);
+                auto found = table->instance_keys.find(handle);
+                if (found != table->instance_keys.end())
+                {
+                  table->erase_row(found->second, handle);
+                  table->instance_keys.erase(found);
+                }
+              }
+            }
+          },
+            [subscriber, subscription](std::exception_ptr eptr)
+          {
+            subscriber.on_error(eptr);
+            subscription.unsubscribe();
+          }));
+
+          subscription.add(prev.subscribe(
+            [subscriber, subscription, table, probe_key_selector](const T & t)
+          {
+            try {
+              const Key & key = remove_const(probe_key_selector)(t);
+              std::shared_ptr<const V> value;
+              {
+                std::unique_lock<std::mutex> guard(table->lock);
+                auto found = table->rows.find(key);
+                if (found != table->rows.end())
+                  value = found->second.value;
+              }
+
+              if (value)
+                subscriber.on_next(Joined(t, std::move(value)));
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [subscriber](std::exception_ptr eptr) { subscriber.on_error(eptr); },
+            [subscriber]() { subscriber.on_completed(); }));
+
+          return subscription;
+        });
+      }
     };
 
-    template <class T>
-    struct CombineLatestSubscriptionState
+    template <class Coordination>
+    class ConflatePerInstanceOp
     {
-      std::mutex lock;
-      std::vector<T> result_vector;
-      std::vector<char> init_vector;
-      rxcpp::composite_subscription subscription;
-      size_t init_count;
-      size_t expected_count;
-      size_t completed_count;
+      rxcpp::schedulers::scheduler::clock_type::duration period_;
+      Coordination coordination_;
 
-      explicit CombineLatestSubscriptionState(size_t expected)
-        : result_vector(expected, T()),
-          init_vector(expected, 0),
-          subscription(),
-          init_count(0),
-          expected_count(expected),
-          completed_count(0)
+    public:
+
+      ConflatePerInstanceOp(rxcpp::schedulers::scheduler::clock_type::duration period,
+                            Coordination coordination)
+        : period_(period),
+          coordination_(std::move(coordination))
       { }
+
+      template <class Observable>
+      rxcpp::observable<typename Observable::value_type::DataType> 
+        operator ()(Observable prev) const
+      {
+        typedef typename Observable::value_type LoanedSample;
+        typedef typename LoanedSample::DataType T;
+
+        // Instances get a dense slot that is reused for as long as the 
+        // instance lives; a flush only visits the slots that changed.
+        struct ConflationState
+        {
+          std::mutex lock;
+          std::unordered_map<dds::core::InstanceHandle, size_t> slot_index;
+          std::vector<T> latest;
+          std::vector<char> dirty;
+          std::vector<size_t> dirty_slots;
+          std::vector<size_t> free_slots;
+
+          size_t acquire_slot(const dds::core::InstanceHandle & handle)
+          {
+            auto found = slot_index.find(handle);
+            if (found != slot_index.end())
+              return found->second;
+
+            size_t slot;
+            if (free_slots.empty())
+            {
+              slot = latest.size();
+              latest.push_back(T());
+              dirty.push_back(0);
+            }
+            else
+            {
+              slot = free_slots.back();
+              free_slots.pop_back();
+            }
+            slot_index.emplace(handle, slot);
+            return slot;
+          }
+
+          // Called with the lock held. A pending update goes out before
+          // the slot is reused, as it would on completion.
+          void release_slot(const dds::core::InstanceHandle & handle,
+                            const rxcpp::subscriber<T> & subscriber)
+          {
+            auto found = slot_index.find(handle);
+            if (found != slot_index.end())
+            {
+              size_t slot = found->second;
+              free_slots.push_back(slot);
+              slot_index.erase(found);
+
+              if (dirty[slot])
+              {
+                dirty[slot] = 0;
+                subscriber.on_next(latest[slot]);
+              }
+            }
+          }
+
+          // Called with the lock held.
+          void flush(const rxcpp::subscriber<T> & subscriber)
+          {
+            for (size_t slot : dirty_slots)
+            {
+              // Released (disposed) since it was marked, and already out.
+              if (!dirty[slot])
+                continue;
+
+              dirty[slot] = 0;
+              subscriber.on_next(latest[slot]);
+            }
+            dirty_slots.clear();
+          }
+        };
+
+        // One timer for all the subscriptions to the conflated stream.
+        auto ticks = 
+          rxcpp::observable<>::interval(period_, coordination_)
+            .publish()
+            .ref_count();
+
+        return rxcpp::observable<>::create<T>(
+          [prev, ticks](rxcpp::subscriber<T> subscriber)
+        {
+          auto state = std::make_shared<ConflationState>();
+          rxcpp::composite_subscription subscription;
+
+          subscription.add(prev.subscribe(
+            [state, subscriber, subscription](const LoanedSample & sample)
+          {
+            std::unique_lock<std::mutex> guard(state->lock);
+            try {
+              unsigned char flags = sample_flags(sample);
+              if (flags & SAMPLE_VALID)
+              {
+                size_t slot = state->acquire_slot(sample_instance_handle(sample));
+                state->latest[slot] = sample.data();
+                if (!state->dirty[slot])
+                {
+                  state->dirty[slot] = 1;
+                  state->dirty_slots.push_back(slot);
+                }
+              }
+              else if (flags & (SAMPLE_DISPOSED | SAMPLE_NO_WRITERS))
+                state->release_slot(sample_instance_handle(sample), subscriber);
+            }
+            catch (...)
+            {
+              subscriber.on_error(std::current_exception());
+              subscription.unsubscribe();
+            }
+          },
+            [state, subscriber, subscription](std::exception_ptr eptr) 
+          { 
+            {
+              std::unique_lock<std::mutex> guard(state->lock);
+              subscriber.on_error(eptr); 
+            }
+            subscription.unsubscribe();
+          },
+            [state, subscriber, subscription]() 
+          { 
+            // The last update of every instance still goes out.
+            {
+              std::unique_lock<std::mutex> guard(state->lock);
+              state->flush(subscriber);
+              subscriber.on_completed(); 
+            }
+            subscription.unsubscribe();
+          }));
+
+          subscription.add(ticks.subscribe(
+            [state, subscriber](long)
+          {
+            std::unique_lock<std::mutex> guard(state->lock);
+            if (subscriber.is_subscribed())
+              state->flush(subscriber);
+          }));
+
+          return subscription;
+        });
+      }
     };
   } // namespace detail
 
@@ -1035,6 +4859,32 @@ namespace rx4dds {
     return detail::MapSampleToDataOp();
   }
 
+  template <bool CompleteOnDispose = true, 
+            bool ErrorOnNoWriters = true, 
+            bool SkipInvalid = true, 
+            bool MapToData = true>
+  detail::InstanceLifecycleOp<CompleteOnDispose, ErrorOnNoWriters, SkipInvalid, MapToData> 
+    instance_lifecycle()
+  {
+    return detail::InstanceLifecycleOp<CompleteOnDispose, ErrorOnNoWriters, SkipInvalid, MapToData>();
+  }
+
+  template <bool MapToData = true>
+  detail::LifecycleEventsOp<MapToData> lifecycle_events()
+  {
+    return detail::LifecycleEventsOp<MapToData>();
+  }
+
+  inline detail::MapSampleToDataRefOp map_samples_to_data_ref()
+  {
+    return detail::MapSampleToDataRefOp();
+  }
+
+  inline detail::ToSamplesOp to_samples()
+  {
+    return detail::ToSamplesOp();
+  }
+
   inline detail::UnkeyOp to_unkeyed()
   {
     return detail::UnkeyOp();
@@ -1052,6 +4902,125 @@ namespace rx4dds {
     return detail::PublishOverDDSOp<T>(datawriter, dispose_instance);
   }
 
+  // Same as above, but registers each instance once, keyed by 
+  // key_selector(t), and writes with the cached handle. key_selector 
+  // must return the key fields of T in a hashable form. It runs for 
+  // every value, so return a const reference to the key field (e.g., 
+  // -> const dds::core::string &) or a precomputed integral key rather
+  // than a copy.
+  template<class T, class KeySelector>
+  detail::KeyedPublishOverDDSOp<T, KeySelector> publish_over_dds(dds::pub::DataWriter<T> datawriter,
+                                                                 const T & dispose_instance,
+                                                                 KeySelector key_selector)
+  {
+    return detail::KeyedPublishOverDDSOp<T, KeySelector>(datawriter, dispose_instance, key_selector);
+  }
+
+  // Writes fill(u, sample) for every value u of the pipeline, filling 
+  // one reused sample instead of mapping each u to a new T. Meant for 
+  // large types, where building and copying a T per value dominates.
+  template<class T, class Fill>
+  detail::PublishInPlaceOverDDSOp<T, Fill, false> publish_in_place_over_dds(dds::pub::DataWriter<T> datawriter,
+                                                                            const T & dispose_instance,
+                                                                            Fill fill)
+  {
+    return detail::PublishInPlaceOverDDSOp<T, Fill, false>(datawriter, dispose_instance, fill);
+  }
+
+#if RX4DDS_HAVE_WRITER_LOAN
+  // Same as publish_in_place_over_dds, but fill() writes straight into a
+  // sample loaned by the DataWriter, so a FlatData or zero-copy type is
+  // never copied by the application.
+  template<class T, class Fill>
+  detail::PublishInPlaceOverDDSOp<T, Fill, true> publish_loaned_over_dds(dds::pub::DataWriter<T> datawriter,
+                                                                         const T & dispose_instance,
+                                                                         Fill fill)
+  {
+    return detail::PublishInPlaceOverDDSOp<T, Fill, true>(datawriter, dispose_instance, fill);
+  }
+#endif
+
+  // Consumes a stream of grouped streams, e.g., from 
+  // group_by_dds_instance(), and writes each group as the instance 
+  // named by its key. Emits the values written.
+  template<class T>
+  detail::PublishGroupedOverDDSOp<T> publish_grouped_over_dds(dds::pub::DataWriter<T> datawriter,
+                                                              InstanceEndPolicy end_policy = InstanceEndPolicy::DISPOSE)
+  {
+    return detail::PublishGroupedOverDDSOp<T>(datawriter, end_policy);
+  }
+
+  // Same as publish_over_dds, but write() runs on a writer thread of 
+  // its own, so a slow reliable writer doesn't stall the dispatch 
+  // thread. Each batch the thread picks up is written and flushed 
+  // together, e.g., for the batching_profile of the soccer example.
+  // When the source ends or the subscription goes away, the thread gets
+  // drain_timeout to write what is still queued, and the rest is 
+  // discarded; pass 0 to discard it right away. Nothing waits for it: 
+  // completion, or the first error of the source, of a write or of the
+  // dispose, is delivered from the writer thread once it is done.
+  // CONFLATE_PER_INSTANCE needs the overload with a key selector.
+  template<class T>
+  detail::AsyncPublishOverDDSOp<T, detail::NoInstanceKey> 
+    publish_over_dds_async(dds::pub::DataWriter<T> datawriter,
+                           const T & dispose_instance,
+                           size_t capacity = 1024,
+                           OverflowPolicy policy = OverflowPolicy::BLOCK,
+                           std::chrono::milliseconds drain_timeout = std::chrono::milliseconds(1000))
+  {
+    if (policy == OverflowPolicy::CONFLATE_PER_INSTANCE)
+      throw std::invalid_argument("publish_over_dds_async: CONFLATE_PER_INSTANCE needs a key selector");
+
+    return detail::AsyncPublishOverDDSOp<T, detail::NoInstanceKey>(
+      datawriter, dispose_instance, capacity, policy, detail::NoInstanceKey(), drain_timeout);
+  }
+
+  // Same as above, with key_selector naming the instance of a value
+  // for CONFLATE_PER_INSTANCE, e.g., the color of a ShapeType. It runs
+  // on the thread that delivers the values, so the dispatch thread 
+  // never calls lookup_instance or register_instance. Keep it cheap.
+  template<class T, class KeySelector>
+  detail::AsyncPublishOverDDSOp<T, KeySelector> 
+    publish_over_dds_async(dds::pub::DataWriter<T> datawriter,
+                           const T & dispose_instance,
+                           size_t capacity,
+                           OverflowPolicy policy,
+                           KeySelector key_selector,
+                           std::chrono::milliseconds drain_timeout = std::chrono::milliseconds(1000))
+  {
+    return detail::AsyncPublishOverDDSOp<T, KeySelector>(
+      datawriter, dispose_instance, capacity, policy, key_selector, drain_timeout);
+  }
+
+  // Lets at most rate values per second through, e.g., in front of
+  // publish_over_dds. It waits on the thread that delivers the values,
+  // so give it a thread of its own (or the dispatch thread of a 
+  // publisher-only application). See TokenBucket for burst.
+  inline detail::PaceOp pace(double rate, double burst = 0)
+  {
+    return detail::PaceOp(rate, burst);
+  }
+
+  // Place before a publish_over_dds of the same writer: while the 
+  // writer is congested, keeps only the latest capacity values instead
+  // of blocking in write().
+  template <class W>
+  detail::ShedOnBackpressureOp<W, detail::DropOldestShedding> 
+    drop_oldest_on_backpressure(WriterBackpressure<W> pressure, size_t capacity)
+  {
+    detail::DropOldestShedding shedding = { capacity };
+    return detail::ShedOnBackpressureOp<W, detail::DropOldestShedding>(pressure, shedding);
+  }
+
+  // Same, but keeps the latest value per key_selector(value).
+  template <class W, class KeySelector>
+  detail::ShedOnBackpressureOp<W, detail::ConflateShedding<KeySelector>> 
+    conflate_on_backpressure(WriterBackpressure<W> pressure, KeySelector key_selector)
+  {
+    detail::ConflateShedding<KeySelector> shedding = { key_selector };
+    return detail::ShedOnBackpressureOp<W, detail::ConflateShedding<KeySelector>>(pressure, shedding);
+  }
+
   template <class OnNext, class OnError, class OnCompleted>
   detail::DoOp<OnNext, OnError, OnCompleted> do_effect(OnNext&& on_next, OnError&& on_error, OnCompleted&& on_completed)
   {
@@ -1154,4 +5123,346 @@ namespace rx4dds {
     return rx4dds::combine_latest(sources);
   }
 
+  inline detail::SourceTimestamp source_timestamp()
+  {
+    return detail::SourceTimestamp();
+  }
+
+  // Aggregates over the elements whose timestamps are within the given 
+  // window of the most recent one. The accumulator is invoked as 
+  // accumulator(seed, new_value, expired_values, window_count) and 
+  // its return value becomes the new seed, which is emitted.
+  // Timestamps are whatever the timestamp_fn returns, e.g. 
+  // SensorData::ts or source_timestamp(), and window is in those units.
+  // The window keeps LoanedSample<T> and Sample<T> elements as owned 
+  // Sample<T> copies, so with those the accumulator sees Sample<T>s.
+  template <class TimestampFn, class Seed, class Accumulator>
+  detail::TimeWindowAggregateOp<TimestampFn, Seed, Accumulator> 
+    time_window_aggregate(long long window,
+                          TimestampFn timestamp_fn,
+                          Seed seed,
+                          Accumulator accumulator)
+  {
+    return detail::TimeWindowAggregateOp<TimestampFn, Seed, Accumulator>(
+      window, 
+      std::move(timestamp_fn), 
+      std::move(seed), 
+      std::move(accumulator));
+  }
+
+  // Sliding aggregate of the last count elements under an associative
+  // combine function, e.g. min or max. Amortized O(1) per element 
+  // regardless of the window size.
+  template <class Combine>
+  detail::CountWindowCombineOp<Combine> 
+    window_aggregate(size_t count, Combine combine)
+  {
+    return detail::CountWindowCombineOp<Combine>(count, std::move(combine));
+  }
+
+  // Same as above but the window holds the elements whose timestamps 
+  // are within window of the most recent one.
+  template <class TimestampFn, class Combine>
+  detail::TimeWindowCombineOp<TimestampFn, Combine>
+    window_aggregate(long long window, TimestampFn timestamp_fn, Combine combine)
+  {
+    return detail::TimeWindowCombineOp<TimestampFn, Combine>(
+      window,
+      std::move(timestamp_fn),
+      std::move(combine));
+  }
+
+  // Computes the same aggregate over several sliding windows at once. 
+  // The stream is cut into panes of gcd(window_lengths) timestamp units,
+  // each pane is reduced once with lift and combine, and every window is
+  // then assembled from pane aggregates only. Whenever a pane closes 
+  // the aggregates of all windows, in the order given, are emitted.
+  // A window length of zero stands for an unbounded window.
+  template <class TimestampFn, class Lift, class Combine>
+  detail::MultiWindowAggregateOp<TimestampFn, Lift, Combine>
+    multi_window_aggregate(std::vector<long long> window_lengths,
+                           TimestampFn timestamp_fn,
+                           Lift lift,
+                           Combine combine)
+  {
+    return detail::MultiWindowAggregateOp<TimestampFn, Lift, Combine>(
+      std::move(window_lengths),
+      std::move(timestamp_fn),
+      std::move(lift),
+      std::move(combine));
+  }
+
+  // Incremental counterpart of coalesce_alive(). Instead of the whole 
+  // set of alive streams, the aggregators only see the stream that was
+  // just added or removed: seed = on_add(seed, stream) when a grouped 
+  // stream shows up and seed = on_remove(seed, stream) when it completes
+  // or fails. The seed is emitted after every change.
+  template <class Seed, class OnAdd, class OnRemove>
+  detail::ActiveKeyScanOp<Seed, OnAdd, OnRemove>
+    active_key_scan(Seed seed, OnAdd on_add, OnRemove on_remove)
+  {
+    return detail::ActiveKeyScanOp<Seed, OnAdd, OnRemove>(
+      std::move(seed),
+      std::move(on_add),
+      std::move(on_remove));
+  }
+
+  // Moves a stream into event time. Every element is stamped with 
+  // timestamp_fn and the watermark trails the largest timestamp seen 
+  // by max_lateness. Elements older than the current watermark are 
+  // late: they are handed to late_handler(element, timestamp), e.g. 
+  // to push them into a side-output subject, and not forwarded.
+  template <class TimestampFn, class LateHandler>
+  detail::AssignWatermarksOp<TimestampFn, LateHandler>
+    assign_watermarks(TimestampFn timestamp_fn, 
+                      long long max_lateness,
+                      LateHandler late_handler)
+  {
+    return detail::AssignWatermarksOp<TimestampFn, LateHandler>(
+      std::move(timestamp_fn),
+      max_lateness,
+      std::move(late_handler));
+  }
+
+  template <class TimestampFn>
+  detail::AssignWatermarksOp<TimestampFn, detail::DropLateData>
+    assign_watermarks(TimestampFn timestamp_fn, long long max_lateness)
+  {
+    return detail::AssignWatermarksOp<TimestampFn, detail::DropLateData>(
+      std::move(timestamp_fn),
+      max_lateness,
+      detail::DropLateData());
+  }
+
+  inline detail::DropWatermarksOp drop_watermarks()
+  {
+    return detail::DropWatermarksOp();
+  }
+
+  // Tumbling windows of the given length over an event-time stream. 
+  // Each window is emitted (and its state released) once the watermark
+  // passes its end; empty windows are not emitted. Elements of a window
+  // that was already emitted are handed to late_handler(element, timestamp).
+  template <class Seed, class Accumulator, class LateHandler>
+  detail::TumblingEventWindowOp<Seed, Accumulator, LateHandler>
+    event_time_window(long long length, 
+                      Seed seed, 
+                      Accumulator accumulator, 
+                      LateHandler late_handler)
+  {
+    return detail::TumblingEventWindowOp<Seed, Accumulator, LateHandler>(
+      length,
+      std::move(seed),
+      std::move(accumulator),
+      std::move(late_handler));
+  }
+
+  template <class Seed, class Accumulator>
+  detail::TumblingEventWindowOp<Seed, Accumulator, detail::DropLateData>
+    event_time_window(long long length, Seed seed, Accumulator accumulator)
+  {
+    return detail::TumblingEventWindowOp<Seed, Accumulator, detail::DropLateData>(
+      length,
+      std::move(seed),
+      std::move(accumulator),
+      detail::DropLateData());
+  }
+
+  // Restores timestamp order across samples from several writers. 
+  // Samples are held in a min-heap and released once the newest 
+  // timestamp seen is max_delay past them. At most max_buffered samples
+  // are held, the heap growing to that size only as samples wait; beyond
+  // that the oldest is released early. Samples older 
+  // than one already released are dropped. Counters go to stats, if given.
+  // LoanedSample<T> and Sample<T> come out as owned Sample<T> copies.
+  template <class TimestampFn>
+  detail::ReorderByTimestampOp<TimestampFn>
+    reorder_by_timestamp(TimestampFn timestamp_fn,
+                         long long max_delay,
+                         size_t max_buffered = 65536,
+                         std::shared_ptr<ReorderStats> stats = std::shared_ptr<ReorderStats>())
+  {
+    return detail::ReorderByTimestampOp<TimestampFn>(
+      std::move(timestamp_fn),
+      max_delay,
+      max_buffered,
+      stats);
+  }
+
+  // Symmetric hash join of two event-time streams (see assign_watermarks).
+  // A left and a right sample join when their keys are equal and their 
+  // timestamps are at most window apart. Each side keeps per-key buffers
+  // in timestamp order, which are trimmed, and dropped once empty, as the
+  // other side's watermark advances. The output is stamped with the later of the two timestamps
+  // and carries the smaller of the two input watermarks.
+  // LoanedSample<T> and Sample<T> values are buffered, and paired, as
+  // owned Sample<T> copies.
+  template <class LeftObservable, class RightObservable, class KeyLeft, class KeyRight>
+  rxcpp::observable<
+    Timestamped<std::pair<typename detail::owned_value<typename LeftObservable::value_type::value_type>::type,
+                          typename detail::owned_value<typename RightObservable::value_type::value_type>::type>>>
+    window_join(LeftObservable left,
+                RightObservable right,
+                KeyLeft key_left,
+                KeyRight key_right,
+                long long window)
+  {
+    typedef typename LeftObservable::value_type::value_type LeftIn;
+    typedef typename RightObservable::value_type::value_type RightIn;
+    typedef typename detail::owned_value<LeftIn>::type L;
+    typedef typename detail::owned_value<RightIn>::type R;
+    typedef typename std::decay<typename std::result_of<KeyLeft(const LeftIn &)>::type>::type Key;
+    typedef std::pair<L, R> Joined;
+    typedef detail::WindowJoinState<L, R, Key> State;
+
+    return rxcpp::observable<>::create<Timestamped<Joined>>(
+      [left, right, key_left, key_right, window](rxcpp::subscriber<Timestamped<Joined>> subscriber)
+    {
+      auto state = std::make_shared<State>();
+
+      auto emit_left_right = [subscriber](const Timestamped<L> & l, const Timestamped<R> & r) {
+        subscriber.on_next(Timestamped<Joined>(std::max(l.timestamp, r.timestamp), Joined(l.value, r.value)));
+      };
+
+      auto emit_right_left = [subscriber](const Timestamped<R> & r, const Timestamped<L> & l) {
+        subscriber.on_next(Timestamped<Joined>(std::max(l.timestamp, r.timestamp), Joined(l.value, r.value)));
+      };
+
+      // Called with the lock held.
+      auto advance_watermark = [state, subscriber, window]() {
+        state->left.evict(state->right_watermark, window);
+        state->right.evict(state->left_watermark, window);
+
+        long long watermark = std::min(state->left_watermark, state->right_watermark);
+        if (watermark > state->emitted_watermark)
+        {
+          state->emitted_watermark = watermark;
+          subscriber.on_next(Timestamped<Joined>::watermark(watermark));
+        }
+      };
+
+      auto on_error = [state, subscriber](std::exception_ptr eptr) {
+        std::unique_lock<std::mutex> guard(state->lock);
+        subscriber.on_error(eptr);
+        state->subscription.unsubscribe();
+      };
+
+      state->subscription.add(left.subscribe(
+        [state, subscriber, key_left, window, emit_left_right, advance_watermark](const Timestamped<LeftIn> & l) 
+      {
+        std::unique_lock<std::mutex> guard(state->lock);
+        try {
+          if (l.is_watermark)
+          {
+            state->left_watermark = std::max(state->left_watermark, l.timestamp);
+            advance_watermark();
+          }
+          else
+          {
+            Timestamped<L> owned(l.timestamp, detail::owned_value<LeftIn>::make(l.value));
+            detail::window_join_probe(owned, detail::remove_const(key_left)(l.value), window, state->right_watermark,
+                                      state->left, state->right, emit_left_right);
+          }
+        }
+        catch (...)
+        {
+          subscriber.on_error(std::current_exception());
+          state->subscription.unsubscribe();
+        }
+      },
+        on_error,
+        [state, subscriber, advance_watermark]() {
+          std::unique_lock<std::mutex> guard(state->lock);
+          state->left_watermark = std::numeric_limits<long long>::max();
+          advance_watermark();
+          if (++state->completed_count == 2)
+            subscriber.on_completed();
+      }));
+
+      state->subscription.add(right.subscribe(
+        [state, subscriber, key_right, window, emit_right_left, advance_watermark](const Timestamped<RightIn> & r) 
+      {
+        std::unique_lock<std::mutex> guard(state->lock);
+        try {
+          if (r.is_watermark)
+          {
+            state->right_watermark = std::max(state->right_watermark, r.timestamp);
+            advance_watermark();
+          }
+          else
+          {
+            Timestamped<R> owned(r.timestamp, detail::owned_value<RightIn>::make(r.value));
+            detail::window_join_probe(owned, detail::remove_const(key_right)(r.value), window, state->left_watermark,
+                                      state->right, state->left, emit_right_left);
+          }
+        }
+        catch (...)
+        {
+          subscriber.on_error(std::current_exception());
+          state->subscription.unsubscribe();
+        }
+      },
+        on_error,
+        [state, subscriber, advance_watermark]() {
+          std::unique_lock<std::mutex> guard(state->lock);
+          state->right_watermark = std::numeric_limits<long long>::max();
+          advance_watermark();
+          if (++state->completed_count == 2)
+            subscriber.on_completed();
+      }));
+
+      return state->subscription;
+    });
+  }
+
+  // Enriches each element with the latest value of a slow keyed topic.
+  // The table side keeps the last valid sample of every instance of 
+  // table_subscription, keyed by table_key_selector, and drops it when
+  // the instance is disposed. Each element is looked up with 
+  // probe_key_selector and emitted paired with a shared pointer to the 
+  // table value; elements without a table entry are skipped.
+  template <class V, class TableKeySelector, class ProbeKeySelector>
+  detail::LookupJoinOp<V, TableKeySelector, ProbeKeySelector>
+    lookup_join(TopicSubscription<V> table_subscription,
+                TableKeySelector table_key_selector,
+                ProbeKeySelector probe_key_selector)
+  {
+    return detail::LookupJoinOp<V, TableKeySelector, ProbeKeySelector>(
+      table_subscription,
+      std::move(table_key_selector),
+      std::move(probe_key_selector));
+  }
+
+  // Keeps only the newest data of every instance and emits the 
+  // instances that changed once per period, from a single timer that 
+  // runs on the given coordination and is shared by all subscriptions
+  // to the result. Downstream work is thus bounded by instances x 
+  // (1 / period) no matter how fast the writers are. Pending updates 
+  // are flushed when the source completes. An instance that is disposed
+  // or loses its writers gets its pending update out right away and is
+  // then forgotten.
+  template <class Coordination>
+  detail::ConflatePerInstanceOp<Coordination>
+    conflate_per_instance(rxcpp::schedulers::scheduler::clock_type::duration period,
+                          Coordination coordination)
+  {
+    return detail::ConflatePerInstanceOp<Coordination>(period, std::move(coordination));
+  }
+
+  inline detail::ConflatePerInstanceOp<rxcpp::observe_on_one_worker>
+    conflate_per_instance(rxcpp::schedulers::scheduler::clock_type::duration period)
+  {
+    return detail::ConflatePerInstanceOp<rxcpp::observe_on_one_worker>(
+      period, 
+      rxcpp::observe_on_event_loop());
+  }
+
+  // Per-instance throttling. On its own it filters on the application
+  // side; pass it to TopicSubscription::create_observable() to have it 
+  // pushed down to the DataReader's TIME_BASED_FILTER as well.
+  inline detail::ThrottlePerInstanceOp throttle_per_instance(const dds::core::Duration & minimum_separation)
+  {
+    return detail::ThrottlePerInstanceOp(minimum_separation);
+  }
+
 } // namespace rx4dds
@@ -0,0 +1,459 @@
+#ifndef SENSOR_CAPTURE_H
+#define SENSOR_CAPTURE_H
+
+/* A columnar binary capture of the DEBS sensor stream, converted once
+ * from the CSV and then memory-mapped for replay.
+ *
+ * Layout (little-endian, every section 8-byte aligned):
+ *
+ *   CaptureHeader
+ *   ts column:    int32 delta from the previous record's ts, or
+ *                 TS_ESCAPE when the delta doesn't fit; the ts is then
+ *                 the next entry of the exception table
+ *   12 columns:   int32 sensor_id, pos_x, pos_y, pos_z, vel, accel,
+ *                 vel_x, vel_y, vel_z, accel_x, accel_y, accel_z
+ *   index:        one CaptureIndexEntry per index_stride records
+ *   exceptions:   int64 absolute ts values
+ *
+ * The index holds the running maximum ts at the end of each block, so
+ * seek() finds a game time with a binary search over the index and a
+ * scan of one block, even though the stream is not strictly sorted.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "sensor_csv.h"
+
+struct CaptureHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t index_stride;
+  uint64_t record_count;
+  uint64_t index_count;
+  uint64_t exception_count;
+  uint64_t index_offset;
+  uint64_t exception_offset;
+  uint64_t column_offset[13];   /* ts first, then the SensorRecord order */
+};
+
+struct CaptureIndexEntry
+{
+  int64_t first_ts;             /* ts of the first record of the block */
+  int64_t max_ts;               /* largest ts up to the end of the block */
+  uint64_t exception_index;     /* exceptions before the block */
+};
+
+namespace sensor_capture {
+
+  const char MAGIC[8] = { 'S', 'N', 'S', 'R', 'C', 'A', 'P', '1' };
+  const uint32_t VERSION = 1;
+  const int32_t TS_ESCAPE = INT32_MIN;
+  const int COLUMN_COUNT = 13;
+
+  inline uint64_t align8(uint64_t offset)
+  {
+    return (offset + 7) & ~(uint64_t) 7;
+  }
+
+  inline int32_t column_value(const SensorRecord & record, int column)
+  {
+    switch (column)
+    {
+      case 1:  return record.sensor_id;
+      case 2:  return record.pos_x;
+      case 3:  return record.pos_y;
+      case 4:  return record.pos_z;
+      case 5:  return record.vel;
+      case 6:  return record.accel;
+      case 7:  return record.vel_x;
+      case 8:  return record.vel_y;
+      case 9:  return record.vel_z;
+      case 10: return record.accel_x;
+      case 11: return record.accel_y;
+      default: return record.accel_z;
+    }
+  }
+
+  /* True if filename starts like a capture file. */
+  inline bool is_capture(const char * filename)
+  {
+    char magic[sizeof(MAGIC)];
+    FILE * file = fopen(filename, "rb");
+    if (file == NULL)
+      return false;
+
+    bool match = (fread(magic, sizeof(magic), 1, file) == 1) &&
+                 (memcmp(magic, MAGIC, sizeof(magic)) == 0);
+    fclose(file);
+    return match;
+  }
+
+  /* Writes each column through its own buffered stream, positioned at
+     the column's offset in the output file, so that the conversion
+     streams through the CSV once without holding the columns in memory. */
+  class ColumnWriter
+  {
+    std::vector<FILE *> streams_;
+    std::string filename_;
+
+    void fail(const char * what)
+    {
+      throw std::runtime_error(std::string(what) + ": " + filename_);
+    }
+
+  public:
+
+    ColumnWriter(const char * filename, const CaptureHeader & header)
+      : filename_(filename)
+    {
+      FILE * file = fopen(filename, "wb");
+      if (file == NULL)
+        fail("Unable to create file");
+      fclose(file);
+
+      for (int column = 0; column < COLUMN_COUNT; ++column)
+      {
+        FILE * stream = fopen(filename, "r+b");
+        if (stream == NULL)
+          fail("Unable to open file");
+        streams_.push_back(stream);
+
+        setvbuf(stream, NULL, _IOFBF, 1 << 16);
+#ifdef _WIN32
+        if (_fseeki64(stream, (__int64) header.column_offset[column], SEEK_SET) != 0)
+#else
+        if (fseeko(stream, (off_t) header.column_offset[column], SEEK_SET) != 0)
+#endif
+          fail("Unable to seek in file");
+      }
+    }
+
+    /* Only a failed conversion leaves streams open for this. */
+    ~ColumnWriter()
+    {
+      for (size_t i = 0; i < streams_.size(); ++i)
+        fclose(streams_[i]);
+    }
+
+    /* Flushes and closes the streams. Throws if any of them fails, 
+       e.g., when the disk is full. */
+    void close()
+    {
+      bool failed = false;
+      for (size_t i = 0; i < streams_.size(); ++i)
+        if (fclose(streams_[i]) != 0)
+          failed = true;
+      streams_.clear();
+
+      if (failed)
+        fail("Unable to write file");
+    }
+
+    void put(int column, int32_t value)
+    {
+      if (fwrite(&value, sizeof(value), 1, streams_[column]) != 1)
+        fail("Unable to write file");
+    }
+
+    /* Writes size bytes at offset through the ts stream, once the
+       columns are done. */
+    void put_at(uint64_t offset, const void * data, size_t size)
+    {
+      FILE * stream = streams_[0];
+#ifdef _WIN32
+      if (_fseeki64(stream, (__int64) offset, SEEK_SET) != 0)
+#else
+      if (fseeko(stream, (off_t) offset, SEEK_SET) != 0)
+#endif
+        fail("Unable to seek in file");
+      if ((size > 0) && (fwrite(data, size, 1, stream) != 1))
+        fail("Unable to write file");
+    }
+  };
+
+  struct ConvertRecord
+  {
+    ColumnWriter * writer;
+    uint32_t index_stride;
+    uint64_t count;
+    int64_t prev_ts;
+    int64_t max_ts;
+    std::vector<CaptureIndexEntry> index;
+    std::vector<int64_t> exceptions;
+
+    void operator()(const SensorRecord & record)
+    {
+      if (count == 0)
+        max_ts = record.ts;
+      else if (record.ts > max_ts)
+        max_ts = record.ts;
+
+      if (count % index_stride == 0)
+      {
+        CaptureIndexEntry entry = { record.ts, max_ts, exceptions.size() };
+        index.push_back(entry);
+      }
+      index.back().max_ts = max_ts;
+
+      int64_t delta = record.ts - prev_ts;
+      if ((count > 0) && (delta > TS_ESCAPE) && (delta <= INT32_MAX))
+        writer->put(0, (int32_t) delta);
+      else
+      {
+        writer->put(0, TS_ESCAPE);
+        exceptions.push_back(record.ts);
+      }
+      prev_ts = record.ts;
+
+      for (int column = 1; column < COLUMN_COUNT; ++column)
+        writer->put(column, column_value(record, column));
+
+      count++;
+    }
+  };
+
+  /* Converts the CSV at csv_filename into a capture file. Returns the
+     number of records. Throws std::runtime_error. */
+  inline uint64_t convert(const char * csv_filename,
+                          const char * capture_filename,
+                          uint32_t index_stride = 1024)
+  {
+    /* One record per line, the last one possibly unterminated. The 
+       CSV is counted a window at a time, as CsvReader reads it. */
+    uint64_t record_count = 0;
+    {
+      MappedFile csv(csv_filename, false);
+      bool terminated = true;
+      for (unsigned long long offset = 0; offset < csv.file_size(); offset += csv.size())
+      {
+        csv.map(offset, 64 << 20);
+        for (const char * p = csv.begin(); 
+             (p = (const char *) memchr(p, '\n', csv.end() - p)) != NULL;
+             ++p)
+          record_count++;
+        terminated = (csv.end()[-1] == '\n');
+      }
+      if (!terminated)
+        record_count++;
+    }
+
+    CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.index_stride = index_stride ? index_stride : 1;
+    header.record_count = record_count;
+    header.index_count = (record_count + header.index_stride - 1) / header.index_stride;
+
+    uint64_t offset = align8(sizeof(CaptureHeader));
+    for (int column = 0; column < COLUMN_COUNT; ++column)
+    {
+      header.column_offset[column] = offset;
+      offset = align8(offset + record_count * sizeof(int32_t));
+    }
+    header.index_offset = offset;
+    header.exception_offset = offset + header.index_count * sizeof(CaptureIndexEntry);
+
+    ColumnWriter writer(capture_filename, header);
+
+    ConvertRecord convert_record;
+    convert_record.writer = &writer;
+    convert_record.index_stride = header.index_stride;
+    convert_record.count = 0;
+    convert_record.prev_ts = 0;
+    convert_record.max_ts = 0;
+
+    CsvReader csv(csv_filename);
+    SensorRecord record;
+    while (csv.next(record))
+      convert_record(record);
+
+    header.exception_count = convert_record.exceptions.size();
+    writer.put_at(header.index_offset,
+                  convert_record.index.empty() ? NULL : &convert_record.index[0],
+                  convert_record.index.size() * sizeof(CaptureIndexEntry));
+    writer.put_at(header.exception_offset,
+                  convert_record.exceptions.empty() ? NULL : &convert_record.exceptions[0],
+                  convert_record.exceptions.size() * sizeof(int64_t));
+    writer.put_at(0, &header, sizeof(header));
+    writer.close();
+
+    return record_count;
+  }
+
+} /* namespace sensor_capture */
+
+/* A capture file opened for replay. It is mapped whole, so the capture 
+   of the full DEBS game needs an x64 build. Throws std::runtime_error. */
+class SensorCapture
+{
+  MappedFile file_;
+  const CaptureHeader * header_;
+  const int32_t * columns_[sensor_capture::COLUMN_COUNT];
+  const CaptureIndexEntry * index_;
+  const int64_t * exceptions_;
+
+  SensorCapture(const SensorCapture &);
+  SensorCapture & operator = (const SensorCapture &);
+
+public:
+
+  /* Reads records one after the other, from any position. */
+  class Cursor
+  {
+    const SensorCapture * capture_;
+    uint64_t position_;
+    uint64_t exception_;
+    int64_t ts_;
+
+  public:
+
+    Cursor()
+      : capture_(NULL),
+        position_(0),
+        exception_(0),
+        ts_(0)
+    { }
+
+    Cursor(const SensorCapture * capture, uint64_t position)
+      : capture_(capture),
+        position_(0),
+        exception_(0),
+        ts_(0)
+    {
+      uint64_t record_count = capture->header_->record_count;
+      if (position >= record_count)
+      {
+        position_ = record_count;
+        return;
+      }
+
+      /* Rebuild ts from the start of the block. */
+      uint32_t stride = capture->header_->index_stride;
+      const CaptureIndexEntry & entry = capture->index_[position / stride];
+      position_ = position - position % stride;
+      exception_ = entry.exception_index;
+
+      SensorRecord skipped;
+      while (position_ < position)
+        next(skipped);
+    }
+
+    uint64_t position() const
+    {
+      return position_;
+    }
+
+    bool next(SensorRecord & record)
+    {
+      if ((capture_ == NULL) || (position_ >= capture_->header_->record_count))
+        return false;
+
+      int32_t delta = capture_->columns_[0][position_];
+      if (delta == sensor_capture::TS_ESCAPE)
+        ts_ = capture_->exceptions_[exception_++];
+      else
+        ts_ += delta;
+
+      if (position_ % capture_->header_->index_stride == 0)
+        ts_ = capture_->index_[position_ / capture_->header_->index_stride].first_ts;
+
+      const int32_t * const * columns = capture_->columns_;
+      uint64_t i = position_++;
+
+      record.ts        = ts_;
+      record.sensor_id = columns[1][i];
+      record.pos_x     = columns[2][i];
+      record.pos_y     = columns[3][i];
+      record.pos_z     = columns[4][i];
+      record.vel       = columns[5][i];
+      record.accel     = columns[6][i];
+      record.vel_x     = columns[7][i];
+      record.vel_y     = columns[8][i];
+      record.vel_z     = columns[9][i];
+      record.accel_x   = columns[10][i];
+      record.accel_y   = columns[11][i];
+      record.accel_z   = columns[12][i];
+      return true;
+    }
+  };
+
+  explicit SensorCapture(const char * filename)
+    : file_(filename)
+  {
+    header_ = (const CaptureHeader *) file_.begin();
+
+    if ((file_.size() < sizeof(CaptureHeader)) ||
+        (memcmp(header_->magic, sensor_capture::MAGIC, sizeof(header_->magic)) != 0) ||
+        (header_->version != sensor_capture::VERSION) ||
+        (header_->index_stride == 0) ||
+        (header_->exception_offset + header_->exception_count * sizeof(int64_t) > file_.size()))
+      throw std::runtime_error(std::string("Not a sensor capture file: ") + filename);
+
+    for (int column = 0; column < sensor_capture::COLUMN_COUNT; ++column)
+      columns_[column] = (const int32_t *) (file_.begin() + header_->column_offset[column]);
+
+    index_ = (const CaptureIndexEntry *) (file_.begin() + header_->index_offset);
+    exceptions_ = (const int64_t *) (file_.begin() + header_->exception_offset);
+  }
+
+  uint64_t size() const
+  {
+    return header_->record_count;
+  }
+
+  /* The first record with a ts of at least ts, or size(): a binary
+     search over the index, then a scan of one block. */
+  uint64_t seek(int64_t ts) const
+  {
+    uint64_t low = 0;
+    uint64_t high = header_->index_count;
+    while (low < high)
+    {
+      uint64_t middle = low + (high - low) / 2;
+      if (index_[middle].max_ts < ts)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+    if (low == header_->index_count)
+      return size();
+
+    /* Only the ts column is decoded on the way. */
+    const CaptureIndexEntry & entry = index_[low];
+    uint64_t position = low * header_->index_stride;
+    uint64_t block_end = position + header_->index_stride;
+    if (block_end > size())
+      block_end = size();
+
+    const int32_t * delta = columns_[0];
+    int64_t record_ts = entry.first_ts;
+    uint64_t exception = entry.exception_index + (delta[position] == sensor_capture::TS_ESCAPE);
+    for (;;)
+    {
+      if (record_ts >= ts)
+        return position;
+      if (++position == block_end)
+        return size();
+
+      if (delta[position] == sensor_capture::TS_ESCAPE)
+        record_ts = exceptions_[exception++];
+      else
+        record_ts += delta[position];
+    }
+  }
+
+  Cursor cursor(uint64_t position) const
+  {
+    return Cursor(this, position);
+  }
+};
+
+#endif /* SENSOR_CAPTURE_H */
@@ -0,0 +1,500 @@
+#ifndef SENSOR_CSV_H
+#define SENSOR_CSV_H
+
+/* Fast reader for the DEBS 2013 sensor CSV:
+ *
+ *   sid,ts,x,y,z,|v|,|a|,vx,vy,vz,ax,ay,az
+ *
+ * The file is memory-mapped, a window at a time, and parsed in place.
+ * Integers are parsed 8 digits at a time with SWAR (SIMD within a 
+ * register) arithmetic on a 64-bit word, which also finds the end of 
+ * each field, so no separate pass splits the lines. Lines that don't fit the fast path (spaces,
+ * CR/LF, the last bytes of the file) go through a scalar parser that
+ * accepts the same input as the original fgets() loop.
+ */
+
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* One line of the CSV. Same fields as SensorData, without DDS. */
+struct SensorRecord
+{
+  int sensor_id;
+  long long ts;
+  int pos_x;
+  int pos_y;
+  int pos_z;
+  int vel;
+  int accel;
+  int vel_x;
+  int vel_y;
+  int vel_z;
+  int accel_x;
+  int accel_y;
+  int accel_z;
+};
+
+/* A read-only view of a file: of the whole file, or of one window of
+   it at a time, so that a 32-bit process can read files larger than
+   its address space. Throws std::runtime_error. */
+class MappedFile
+{
+  const char * view_;           /* the mapping, from an aligned offset */
+  size_t view_size_;
+  const char * data_;           /* the window asked for, within view_ */
+  size_t size_;
+  unsigned long long offset_;
+  unsigned long long file_size_;
+  std::string filename_;
+#ifdef _WIN32
+  HANDLE file_;
+  HANDLE mapping_;
+#else
+  int fd_;
+#endif
+
+  MappedFile(const MappedFile &);
+  MappedFile & operator = (const MappedFile &);
+
+  void fail(const char * what)
+  {
+    close();
+    throw std::runtime_error(std::string(what) + ": " + filename_);
+  }
+
+  void unmap()
+  {
+#ifdef _WIN32
+    if (view_ != NULL)
+      UnmapViewOfFile(view_);
+#else
+    if (view_ != NULL)
+      munmap((void *) view_, view_size_);
+#endif
+    view_ = NULL;
+    view_size_ = 0;
+    data_ = NULL;
+    size_ = 0;
+  }
+
+  /* Views must start at a multiple of this. */
+  static unsigned long long granularity()
+  {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return (unsigned long long) sysconf(_SC_PAGESIZE);
+#endif
+  }
+
+public:
+
+  /* Maps the whole file, unless whole is false: then nothing is mapped
+     until map(). */
+  explicit MappedFile(const char * filename, bool whole = true)
+    : view_(NULL),
+      view_size_(0),
+      data_(NULL),
+      size_(0),
+      offset_(0),
+      file_size_(0),
+      filename_(filename)
+  {
+#ifdef _WIN32
+    mapping_ = NULL;
+    file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+      fail("Unable to open file");
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    file_size_ = (unsigned long long) size.QuadPart;
+
+    if (file_size_ > 0)
+    {
+      mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping_ == NULL)
+        fail("Unable to map file");
+    }
+#else
+    fd_ = open(filename, O_RDONLY);
+    if (fd_ < 0)
+      fail("Unable to open file");
+
+    struct stat st;
+    fstat(fd_, &st);
+    file_size_ = (unsigned long long) st.st_size;
+#endif
+
+    if (whole)
+    {
+      if (file_size_ != (size_t) file_size_)
+        fail("Too large to map whole");
+      map(0, (size_t) file_size_);
+    }
+  }
+
+  ~MappedFile()
+  {
+    close();
+  }
+
+  /* Maps [offset, offset + length) of the file, clipped to its end, in
+     place of the previous window. */
+  void map(unsigned long long offset, size_t length)
+  {
+    unmap();
+
+    if (offset > file_size_)
+      offset = file_size_;
+    if (length > file_size_ - offset)
+      length = (size_t) (file_size_ - offset);
+    offset_ = offset;
+
+    if (length == 0)
+      return;
+
+    unsigned long long view_offset = offset - offset % granularity();
+    size_t view_size = (size_t) (offset - view_offset) + length;
+
+#ifdef _WIN32
+    view_ = (const char *) MapViewOfFile(mapping_, FILE_MAP_READ,
+                                         (DWORD) (view_offset >> 32),
+                                         (DWORD) view_offset,
+                                         view_size);
+    if (view_ == NULL)
+      fail("Unable to map file");
+#else
+    void * view = mmap(NULL, view_size, PROT_READ, MAP_PRIVATE, fd_, (off_t) view_offset);
+    if (view == MAP_FAILED)
+      fail("Unable to map file");
+    view_ = (const char *) view;
+    madvise(view, view_size, MADV_SEQUENTIAL);
+#endif
+
+    view_size_ = view_size;
+    data_ = view_ + (offset - view_offset);
+    size_ = length;
+  }
+
+  void close()
+  {
+    unmap();
+#ifdef _WIN32
+    if (mapping_ != NULL)
+      CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+      CloseHandle(file_);
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+#endif
+  }
+
+  /* The current window. */
+  const char * begin() const { return data_; }
+  const char * end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+
+  /* Where the current window starts in the file. */
+  unsigned long long offset() const { return offset_; }
+  unsigned long long file_size() const { return file_size_; }
+};
+
+namespace sensor_csv {
+
+  typedef unsigned long long u64;
+
+  /* Number of leading ASCII digits in the little-endian word w (0-8). */
+  inline unsigned digit_count(u64 w)
+  {
+    /* A byte is a digit if its high nibble is 3 and adding 6 doesn't
+       carry out of the low nibble. */
+    u64 non_digit = ((w & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL) |
+                    (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL);
+    if (non_digit == 0)
+      return 8;
+
+#if defined(_MSC_VER)
+    unsigned long index;
+#if defined(_M_X64)
+    _BitScanForward64(&index, non_digit);
+#else
+    if ((u64) (unsigned) non_digit != 0)
+      _BitScanForward(&index, (unsigned long) non_digit);
+    else
+    {
+      _BitScanForward(&index, (unsigned long) (non_digit >> 32));
+      index += 32;
+    }
+#endif
+    return index / 8;
+#else
+    return (unsigned) __builtin_ctzll(non_digit) / 8;
+#endif
+  }
+
+  /* The value of the first n (1-8) digits of w. */
+  inline u64 digits_value(u64 w, unsigned n)
+  {
+    w -= 0x3030303030303030ULL;
+    w <<= 8 * (8 - n);     /* the missing digits become leading zeros */
+
+    w = (w * 10 + (w >> 8)) & 0x00FF00FF00FF00FFULL;
+    w = (w * 100 + (w >> 16)) & 0x0000FFFF0000FFFFULL;
+    w = (w * 10000 + (w >> 32)) & 0x00000000FFFFFFFFULL;
+    return w;
+  }
+
+  inline u64 load8(const char * p)
+  {
+    u64 w;
+    memcpy(&w, p, 8);
+    return w;
+  }
+
+  /* Parses [-]digits followed by delimiter, which it skips. Needs the
+     8-byte loads to stay within the buffer: returns false when they
+     may not, or when the field isn't of that form. */
+  inline bool parse_field_fast(const char *& p, 
+                               const char * end, 
+                               char delimiter, 
+                               long long & value)
+  {
+    static const u64 scale[9] = 
+      { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 
+        100000ULL, 1000000ULL, 10000000ULL, 100000000ULL };
+
+    if (p + 8 > end)
+      return false;
+
+    const char * q = p;
+    bool negative = (*q == '-');
+    q += negative;
+
+    u64 result = 0;
+    unsigned total = 0;
+    for (;;)
+    {
+      if (q + 8 > end)
+        return false;
+
+      u64 w = load8(q);
+      unsigned n = digit_count(w);
+      if (n == 0)
+        break;
+
+      result = result * scale[n] + digits_value(w, n);
+      total += n;
+      q += n;
+      if (n < 8)
+        break;
+    }
+
+    if ((total == 0) || (total > 18) || (*q != delimiter))
+      return false;
+
+    value = negative ? -(long long) result : (long long) result;
+    p = q + 1;
+    return true;
+  }
+
+  /* Same rules as myParseLongLong in soccer_publisher.cxx. */
+  inline long long parse_field_slow(const char *& p, const char * end)
+  {
+    long long num = 0;
+    bool neg = false;
+    for (; p < end; ++p)
+    {
+      if ((*p == ' ') || (*p == '\r'))
+        continue;
+      else if ((*p == ',') || (*p == '\n'))
+        break;
+      else if (*p == '-')
+        neg = true;
+      else
+        num = num * 10 + (*p - '0');
+    }
+    if (p < end)
+      ++p;
+    return neg ? -num : num;
+  }
+
+  inline void assign(SensorRecord & record, const long long * v)
+  {
+    record.sensor_id = (int) v[0];
+    record.ts        = v[1];
+    record.pos_x     = (int) v[2];
+    record.pos_y     = (int) v[3];
+    record.pos_z     = (int) v[4];
+    record.vel       = (int) v[5];
+    record.accel     = (int) v[6];
+    record.vel_x     = (int) v[7];
+    record.vel_y     = (int) v[8];
+    record.vel_z     = (int) v[9];
+    record.accel_x   = (int) v[10];
+    record.accel_y   = (int) v[11];
+    record.accel_z   = (int) v[12];
+  }
+
+  const int FIELD_COUNT = 13;
+
+  /* Parses the line at p into record and returns the start of the next
+     line. */
+  inline const char * parse_line(const char * p, const char * end, SensorRecord & record)
+  {
+    const char * line = p;
+    long long v[FIELD_COUNT];
+
+    int field = 0;
+    for (; field < FIELD_COUNT - 1; ++field)
+      if (!parse_field_fast(p, end, ',', v[field]))
+        break;
+
+    if ((field == FIELD_COUNT - 1) && parse_field_fast(p, end, '\n', v[field]))
+    {
+      assign(record, v);
+      return p;
+    }
+
+    /* Off the fast path: redo the line the forgiving way. */
+    p = line;
+    const char * eol = (const char *) memchr(line, '\n', end - line);
+    const char * line_end = eol ? eol + 1 : end;
+
+    for (field = 0; field < FIELD_COUNT; ++field)
+      v[field] = parse_field_slow(p, line_end);
+
+    assign(record, v);
+    return line_end;
+  }
+
+  /* The start of the line that contains p, or of the next one. */
+  inline const char * next_line(const char * begin, const char * p, const char * end)
+  {
+    if ((p == begin) || (p >= end))
+      return p;
+    if (p[-1] == '\n')
+      return p;
+
+    const char * eol = (const char *) memchr(p, '\n', end - p);
+    return eol ? eol + 1 : end;
+  }
+
+  /* Calls func(record) for every line of [begin, end). */
+  template <class Func>
+  size_t for_each_record(const char * begin, const char * end, Func & func)
+  {
+    SensorRecord record;
+    size_t lines = 0;
+
+    for (const char * p = begin; p < end; ++lines)
+    {
+      p = parse_line(p, end, record);
+      func(record);
+    }
+    return lines;
+  }
+
+  /* Splits [begin, end) at line boundaries into thread_count chunks,
+     parses them on as many threads and calls funcs[i](record) for the
+     records of chunk i, in file order within the chunk. Returns the
+     number of lines. */
+  template <class Func>
+  size_t parallel_for_each_record(const char * begin,
+                                  const char * end,
+                                  std::vector<Func> & funcs)
+  {
+    size_t thread_count = funcs.size();
+    if (thread_count <= 1)
+      return thread_count ? for_each_record(begin, end, funcs[0]) : 0;
+
+    std::vector<const char *> bounds(thread_count + 1);
+    bounds[0] = begin;
+    bounds[thread_count] = end;
+    for (size_t i = 1; i < thread_count; ++i)
+      bounds[i] = next_line(begin, begin + (end - begin) * i / thread_count, end);
+
+    std::vector<size_t> lines(thread_count, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+      threads.push_back(std::thread([&bounds, &lines, &funcs, i]() {
+        lines[i] = for_each_record(bounds[i], bounds[i + 1], funcs[i]);
+      }));
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+      threads[i].join();
+      total += lines[i];
+    }
+    return total;
+  }
+
+} /* namespace sensor_csv */
+
+/* Reads the records of a CSV through a window of the file that slides
+   along as the lines are read, so that the whole DEBS game replays in
+   a 32-bit process. The window moves on when less than MARGIN bytes 
+   are left in it: a line must be shorter than that. */
+class CsvReader
+{
+  enum { WINDOW = 64 << 20, MARGIN = 4096 };
+
+  MappedFile file_;
+  const char * next_;
+
+  CsvReader(const CsvReader &);
+  CsvReader & operator = (const CsvReader &);
+
+public:
+
+  explicit CsvReader(const char * filename)
+    : file_(filename, false),
+      next_(NULL)
+  {
+    file_.map(0, WINDOW);
+    next_ = file_.begin();
+  }
+
+  bool next(SensorRecord & record)
+  {
+    if ((file_.end() - next_ < MARGIN) && 
+        (file_.offset() + file_.size() < file_.file_size()))
+    {
+      file_.map(file_.offset() + (next_ - file_.begin()), WINDOW);
+      next_ = file_.begin();
+    }
+
+    if (next_ >= file_.end())
+      return false;
+
+    next_ = sensor_csv::parse_line(next_, file_.end(), record);
+    return true;
+  }
+};
+
+#endif /* SENSOR_CSV_H */
@@ -1,10 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <memory>
 
 #include "soccer.h"
 #include "soccerSupport.h"
 #include "ndds/ndds_cpp.h"
+#include "rx4dds/pacing.h"
+#include "sensor_csv.h"
+#include "sensor_capture.h"
 
 #if defined(_MSC_VER) || defined(_MSC_EXTENSIONS)
   #define DELTA_EPOCH_IN_MICROSECS  11644473600000000Ui64
@@ -185,7 +190,48 @@ void print(SensorData * sensor_data)
       sensor_data->accel_z);
 }
 
-extern "C" int publisher_main(int domainId, char * filename, int sample_count, int target_rate)
+/* The records to publish: the lines of the CSV, or the records of a
+   capture file from the first one at start_ts on. */
+struct ReplaySource
+{
+  std::unique_ptr<CsvReader> csv;
+  std::unique_ptr<SensorCapture> capture;
+  SensorCapture::Cursor cursor;
+
+  ReplaySource() { }
+
+  void open(const char * filename, long long start_ts)
+  {
+    if (sensor_capture::is_capture(filename))
+    {
+      capture.reset(new SensorCapture(filename));
+      cursor = capture->cursor(capture->seek(start_ts));
+      printf("Replaying from record %llu of %llu\n",
+             (unsigned long long) cursor.position(), (unsigned long long) capture->size());
+    }
+    else
+    {
+      if (start_ts != 0)
+        throw std::runtime_error("A start ts needs a capture file, see --convert");
+
+      csv.reset(new CsvReader(filename));
+    }
+  }
+
+  bool next(SensorRecord & record)
+  {
+    if (capture)
+      return cursor.next(record);
+
+    return csv->next(record);
+  }
+
+private:
+  ReplaySource(const ReplaySource &);
+  ReplaySource & operator = (const ReplaySource &);
+};
+
+extern "C" int publisher_main(int domainId, char * filename, int sample_count, int target_rate, long long start_ts)
 {
     DDSDomainParticipant *participant = NULL;
     DDSPublisher *publisher = NULL;
@@ -272,17 +318,16 @@ extern "C" int publisher_main(int domainId, char * filename, int sample_count, i
     if(wait_for_readers(SensorData_writer, 1) != true)
       return -1;
 	
-	FILE *fin = NULL;
-	fin = fopen (filename, "r");
-
-	if (fin == NULL) {
-		printf("Unable to open file: %s\n", filename);
-		perror("Error");
+	ReplaySource input;
+	try {
+		input.open(filename, start_ts);
+	}
+	catch (std::exception & ex) {
+		printf("%s\n", ex.what());
 		publisher_shutdown(participant);
 		return -1;
 	}
 
-	//fseek (fin, 131435030, SEEK_SET);
 	int lines_read = 0;
 	int calc_point = 100000;
 
@@ -290,64 +335,37 @@ extern "C" int publisher_main(int domainId, char * filename, int sample_count, i
   gettimeofday(&start, NULL);
   prev = start;
 
-  char line[1024];
-  bool myparse = true;
+  // Paces every sample. Tokens left over from a slow write are spent
+  // right away, up to 10 ms worth.
+  rx4dds::TokenBucket pacer(target_rate != 0 ? target_rate : 1);
+
+  SensorRecord record;
 	for (count=0; (sample_count == 0) || (count < sample_count);) 
 	{
-    if(myparse)
-    {
-      if(NULL == fgets(line, 2014, fin))
-        break;
+    if (!input.next(record))
+      break;
+
+    lines_read++;
+
+    sensor_data->sensor_id = record.sensor_id;
+    sensor_data->ts        = record.ts;
+    sensor_data->pos_x     = record.pos_x;
+    sensor_data->pos_y     = record.pos_y;
+    sensor_data->pos_z     = record.pos_z;
+    sensor_data->vel       = record.vel;
+    sensor_data->accel     = record.accel;
+    sensor_data->vel_x     = record.vel_x;
+    sensor_data->vel_y     = record.vel_y;
+    sensor_data->vel_z     = record.vel_z;
+    sensor_data->accel_x   = record.accel_x;
+    sensor_data->accel_y   = record.accel_y;
+    sensor_data->accel_z   = record.accel_z;
+
+    //print(sensor_data);
+
+    if (target_rate != 0)
+      pacer.acquire();
 
-      lines_read++;
-      int pos = 0;
-      int length = strlen(line);
-      sensor_data->sensor_id = myParseInt32(line, length, &pos);
-      /*
-      if((sensor_data->sensor_id == 4)  ||
-		     (sensor_data->sensor_id == 8)  ||
-		     (sensor_data->sensor_id == 10) ||
-		     (sensor_data->sensor_id == 12))
-      {
-        continue;
-      }*/
-
-      sensor_data->ts        = myParseLongLong(line,  length, &pos);
-      sensor_data->pos_x     = myParseInt32(line, length, &pos);
-      sensor_data->pos_y     = myParseInt32(line, length, &pos);
-      sensor_data->pos_z     = myParseInt32(line, length, &pos);
-      sensor_data->vel       = myParseInt32(line, length, &pos);
-      sensor_data->accel     = myParseInt32(line, length, &pos);
-      sensor_data->vel_x     = myParseInt32(line, length, &pos);
-      sensor_data->vel_y     = myParseInt32(line, length, &pos);
-      sensor_data->vel_z     = myParseInt32(line, length, &pos);
-      sensor_data->accel_x   = myParseInt32(line, length, &pos);
-      sensor_data->accel_y   = myParseInt32(line, length, &pos);
-      sensor_data->accel_z   = myParseInt32(line, length, &pos);
-
-      //print(sensor_data);
-    }
-    else 
-    {
-      if(EOF==fscanf(fin, "%hu,%llu,%d,%d,%d,%u,%d,%d,%d,%d,%d,%d,%d",
-              &sensor_data->sensor_id,
-						  &sensor_data->ts,
-						  &sensor_data->pos_x,
-						  &sensor_data->pos_y,
-						  &sensor_data->pos_z,
-						  &sensor_data->vel,
-						  &sensor_data->accel,
-						  &sensor_data->vel_x,
-						  &sensor_data->vel_y,
-						  &sensor_data->vel_z,
-						  &sensor_data->accel_x,
-						  &sensor_data->accel_y,
-						  &sensor_data->accel_z))
-		  {
-			  break;
-		  }
- 		  lines_read++;
-    }
 		retcode = SensorData_writer->write(*sensor_data, DDS_HANDLE_NIL);
 		if (retcode != DDS_RETCODE_OK) {
 			printf("write error %d\n", retcode);
@@ -367,15 +385,18 @@ extern "C" int publisher_main(int domainId, char * filename, int sample_count, i
         double rate = (double)(calc_point*1000L) / (double)(lapse_msec);
         printf("publishing rate: %lf samples/sec\n", rate);
     }
-
-		if((target_rate != 0) && (count % 100==0))
-      NDDSUtility::sleep(DDS_Duration_t::from_micros(1000*1000*100/target_rate*98/100));
 	}
 
   gettimeofday(&end, NULL);
   long total_msec = end - start;
   printf("lines read = %d, count = %d\n", lines_read, count);
   printf("Total sec = %lf and cumulative rate = %lf\n", (double) total_msec/1000, (double)count/total_msec*1000);
+  if (target_rate != 0)
+  {
+    rx4dds::PacingStats stats = pacer.stats();
+    printf("paced rate = %lf samples/sec, %+.3lf%% off target\n", 
+           stats.achieved_rate, stats.error_percent);
+  }
 
   /* Delete data sample */
   retcode = SensorDataTypeSupport::delete_data(sensor_data);
@@ -387,22 +408,162 @@ extern "C" int publisher_main(int domainId, char * filename, int sample_count, i
   return publisher_shutdown(participant);
 }
 
+struct RecordChecksum
+{
+  long long lines;
+  long long sum;
+
+  RecordChecksum() : lines(0), sum(0) { }
+
+  void operator()(const SensorRecord & record)
+  {
+    lines++;
+    sum += record.sensor_id + record.ts + record.pos_x + record.vel + record.accel_z;
+  }
+};
+
+/* Line rate of the fgets() loop against the memory-mapped reader, on
+   one thread through the sliding window the replay uses, and on 
+   thread_count threads over the whole file mapped at once. The target
+   is 10x the fgets() loop. */
+int bench_csv(const char * filename, int thread_count)
+{
+  RecordChecksum fgets_checksum;
+  long long fgets_start = rx4dds::pacing_now_ns();
+  {
+    FILE * fin = fopen(filename, "r");
+    if (fin == NULL) {
+      printf("Unable to open file: %s\n", filename);
+      return -1;
+    }
+
+    char line[1024];
+    SensorRecord record;
+    while (fgets(line, sizeof(line), fin) != NULL)
+    {
+      int pos = 0;
+      int length = strlen(line);
+      record.sensor_id = myParseInt32(line, length, &pos);
+      record.ts        = myParseLongLong(line, length, &pos);
+      record.pos_x     = myParseInt32(line, length, &pos);
+      record.pos_y     = myParseInt32(line, length, &pos);
+      record.pos_z     = myParseInt32(line, length, &pos);
+      record.vel       = myParseInt32(line, length, &pos);
+      record.accel     = myParseInt32(line, length, &pos);
+      record.vel_x     = myParseInt32(line, length, &pos);
+      record.vel_y     = myParseInt32(line, length, &pos);
+      record.vel_z     = myParseInt32(line, length, &pos);
+      record.accel_x   = myParseInt32(line, length, &pos);
+      record.accel_y   = myParseInt32(line, length, &pos);
+      record.accel_z   = myParseInt32(line, length, &pos);
+      fgets_checksum(record);
+    }
+    fclose(fin);
+  }
+  double fgets_sec = (rx4dds::pacing_now_ns() - fgets_start) / 1e9;
+
+  RecordChecksum mapped_checksum;
+  long long mapped_start = rx4dds::pacing_now_ns();
+  {
+    CsvReader reader(filename);
+    SensorRecord record;
+    while (reader.next(record))
+      mapped_checksum(record);
+  }
+  double mapped_sec = (rx4dds::pacing_now_ns() - mapped_start) / 1e9;
+
+  std::vector<RecordChecksum> chunk_checksums(thread_count > 0 ? thread_count : 1);
+  long long parallel_start = rx4dds::pacing_now_ns();
+  try {
+    MappedFile input(filename);
+    sensor_csv::parallel_for_each_record(input.begin(), input.end(), chunk_checksums);
+  }
+  catch (std::exception & ex) {
+    /* A 32-bit process can't map the whole game. */
+    printf("%s\n", ex.what());
+    return -1;
+  }
+  double parallel_sec = (rx4dds::pacing_now_ns() - parallel_start) / 1e9;
+
+  RecordChecksum parallel_checksum;
+  for (size_t i = 0; i < chunk_checksums.size(); ++i)
+  {
+    parallel_checksum.lines += chunk_checksums[i].lines;
+    parallel_checksum.sum += chunk_checksums[i].sum;
+  }
+
+  printf("fgets:           %lf lines/sec\n", fgets_checksum.lines / fgets_sec);
+  printf("mapped:          %lf lines/sec (x%.1lf, %s the x10 target)\n", 
+         mapped_checksum.lines / mapped_sec, fgets_sec / mapped_sec,
+         (fgets_sec / mapped_sec >= 10) ? "meets" : "MISSES");
+  printf("mapped, %d thr:  %lf lines/sec (x%.1lf, %s the x10 target)\n", (int) chunk_checksums.size(),
+         parallel_checksum.lines / parallel_sec, fgets_sec / parallel_sec,
+         (fgets_sec / parallel_sec >= 10) ? "meets" : "MISSES");
+
+  if ((mapped_checksum.lines != fgets_checksum.lines) || (mapped_checksum.sum != fgets_checksum.sum) ||
+      (parallel_checksum.lines != fgets_checksum.lines) || (parallel_checksum.sum != fgets_checksum.sum))
+  {
+    printf("The readers disagree!\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* Converts the CSV into a capture file, once, for replays that start
+   anywhere in the game. */
+int convert_csv(const char * csv_filename, const char * capture_filename)
+{
+  long long start = rx4dds::pacing_now_ns();
+  try {
+    unsigned long long records = sensor_capture::convert(csv_filename, capture_filename);
+    double sec = (rx4dds::pacing_now_ns() - start) / 1e9;
+
+    SensorCapture capture(capture_filename);
+    SensorRecord first, last;
+    SensorCapture::Cursor cursor = capture.cursor(0);
+    if (cursor.next(first))
+    {
+      cursor = capture.cursor(capture.size() - 1);
+      cursor.next(last);
+      printf("ts %lld to %lld\n", first.ts, last.ts);
+    }
+    printf("Converted %llu records in %lf sec\n", records, sec);
+  }
+  catch (std::exception & ex) {
+    printf("%s\n", ex.what());
+    return -1;
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
+  if ((argc >= 3) && (strcmp(argv[1], "--bench-csv") == 0))
+    return bench_csv(argv[2], (argc >= 4) ? atoi(argv[3]) : 4);
+
+  if ((argc >= 4) && (strcmp(argv[1], "--convert") == 0))
+    return convert_csv(argv[2], argv[3]);
+
   int domainId = 0;
   int sample_count = 0; /* infinite loop */
 	char * filename = 0;
 	int target_rate = 0;
+	long long start_ts = 0;
 
 	if (argc < 4) {
-		printf("Usage: soccer-publisher <domain-id> <sensor-data-filename> <max-samples> [target-rate]");
+		printf("Usage: soccer-publisher <domain-id> <sensor-data-filename> <max-samples> [target-rate] [start-ts]\n"
+		       "       soccer-publisher --convert <sensor-data-filename> <capture-filename>\n"
+		       "       soccer-publisher --bench-csv <sensor-data-filename> [threads]\n"
+		       "start-ts needs a capture file as sensor-data-filename.\n");
 		return 1;
 	}
   domainId = atoi(argv[1]);
   filename = argv[2];
 	sample_count = atoi(argv[3]);
-	if (argc == 5)
+	if (argc >= 5)
 	  target_rate = atoi(argv[4]);
+	if (argc >= 6)
+	  sscanf(argv[5], "%lld", &start_ts);
     
-    return publisher_main(domainId, filename, sample_count, target_rate);
+    return publisher_main(domainId, filename, sample_count, target_rate, start_ts);
 }